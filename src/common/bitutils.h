@@ -199,6 +199,21 @@ clz64(uint64_t bits)
 #define clz64 __builtin_clzll
 #endif
 
+#ifdef PLATFORM_WINDOWS
+inline int
+ctz64(uint64_t bits)
+{
+   unsigned long a;
+   if (!_BitScanForward64(&a, bits)) {
+      return 64;
+   } else {
+      return a;
+   }
+}
+#else
+#define ctz64 __builtin_ctzll
+#endif
+
 inline bool
 bit_scan_reverse(unsigned long *out_position, uint32_t bits)
 {
@@ -0,0 +1,147 @@
+#pragma once
+#include "be_array.h"
+#include "be_val.h"
+#include "decaf_assert.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <gsl.h>
+#include <type_traits>
+
+/**
+ * Bulk endian conversion.
+ *
+ * Swaps whole arrays of 16, 32 or 64 bit values at once using the widest
+ * SIMD kernel the host supports, picked the first time any of these are
+ * called.  The copy variants allow dst == src, but the two ranges must not
+ * otherwise overlap.
+ */
+
+enum class ByteSwapKernel
+{
+   Scalar,
+   SSSE3,
+   AVX2,
+};
+
+void
+byte_swap_copy(uint16_t *dst, const uint16_t *src, size_t count);
+
+void
+byte_swap_copy(uint32_t *dst, const uint32_t *src, size_t count);
+
+void
+byte_swap_copy(uint64_t *dst, const uint64_t *src, size_t count);
+
+// Returns the kernel currently in use
+ByteSwapKernel
+byte_swap_kernel();
+
+// Force a kernel, returns false if the host does not support it
+bool
+set_byte_swap_kernel(ByteSwapKernel kernel);
+
+// Returns whether the host supports kernel
+bool
+byte_swap_kernel_supported(ByteSwapKernel kernel);
+
+inline void
+byte_swap_inplace(uint16_t *data, size_t count)
+{
+   byte_swap_copy(data, data, count);
+}
+
+inline void
+byte_swap_inplace(uint32_t *data, size_t count)
+{
+   byte_swap_copy(data, data, count);
+}
+
+inline void
+byte_swap_inplace(uint64_t *data, size_t count)
+{
+   byte_swap_copy(data, data, count);
+}
+
+namespace detail
+{
+
+template<size_t Size>
+struct byte_swap_uint;
+
+template<> struct byte_swap_uint<2> { using type = uint16_t; };
+template<> struct byte_swap_uint<4> { using type = uint32_t; };
+template<> struct byte_swap_uint<8> { using type = uint64_t; };
+
+template<typename Type>
+using byte_swap_uint_t = typename byte_swap_uint<sizeof(Type)>::type;
+
+} // namespace detail
+
+// Any other 2, 4 or 8 byte type, e.g. int16_t, float, double
+template<typename Type>
+inline void
+byte_swap_copy(Type *dst, const Type *src, size_t count)
+{
+   static_assert(std::is_trivially_copyable<Type>::value, "Type must be trivially copyable");
+   using UintType = detail::byte_swap_uint_t<Type>;
+   byte_swap_copy(reinterpret_cast<UintType *>(dst),
+                  reinterpret_cast<const UintType *>(src),
+                  count);
+}
+
+template<typename Type>
+inline void
+byte_swap_inplace(Type *data, size_t count)
+{
+   byte_swap_copy(data, data, count);
+}
+
+// Big endian to host, be_val<Type> has the same layout as Type
+template<typename Type>
+inline void
+byte_swap_copy(Type *dst, const be_val<Type> *src, size_t count)
+{
+   static_assert(sizeof(be_val<Type>) == sizeof(Type), "be_val<Type> must have the same layout as Type");
+   byte_swap_copy(dst, reinterpret_cast<const Type *>(src), count);
+}
+
+// Host to big endian
+template<typename Type>
+inline void
+byte_swap_copy(be_val<Type> *dst, const Type *src, size_t count)
+{
+   static_assert(sizeof(be_val<Type>) == sizeof(Type), "be_val<Type> must have the same layout as Type");
+   byte_swap_copy(reinterpret_cast<Type *>(dst), src, count);
+}
+
+template<typename Type>
+inline void
+byte_swap_inplace(gsl::span<Type> values)
+{
+   byte_swap_inplace(values.data(), static_cast<size_t>(values.size()));
+}
+
+// Swaps all of src into the start of dst, which must be at least as big
+template<typename DstType, typename SrcType>
+inline void
+byte_swap_copy(gsl::span<DstType> dst, gsl::span<SrcType> src)
+{
+   decaf_check(dst.size() >= src.size());
+   byte_swap_copy(dst.data(), src.data(), static_cast<size_t>(src.size()));
+}
+
+template<typename Type, size_t Size>
+inline void
+byte_swap_copy(std::array<Type, Size> &dst, const be_array<Type, Size> &src)
+{
+   byte_swap_copy(dst.data(), src.data(), Size);
+}
+
+template<typename Type, size_t Size>
+inline void
+byte_swap_copy(be_array<Type, Size> &dst, const std::array<Type, Size> &src)
+{
+   byte_swap_copy(dst.data(), src.data(), Size);
+}
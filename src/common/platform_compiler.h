@@ -11,3 +11,13 @@
 #else
 #define CLANG_FPU_BUG_WORKAROUND //nothing
 #endif
+
+// File and line of the caller when used as default arguments, for
+//  instrumentation keyed by call site.  Empty where unsupported.
+#if defined(__GNUC__) || defined(__clang__) || (defined(_MSC_VER) && _MSC_VER >= 1926)
+#define CALLER_FILE_NAME __builtin_FILE()
+#define CALLER_LINE __builtin_LINE()
+#else
+#define CALLER_FILE_NAME ""
+#define CALLER_LINE 0
+#endif
@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <functional>
 
 namespace platform
@@ -15,11 +16,20 @@ struct Exception
    };
 
    Exception(Type type_) :
-      type(type_)
+      type(type_),
+      pc(0),
+      gpr()
    {
    }
 
    Type type;
+
+   //! Host address of the faulting instruction
+   uint64_t pc;
+
+   //! Host general purpose registers at the time of the fault, indexed by
+   //! their x86-64 encoding (RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8-R15)
+   uint64_t gpr[16];
 };
 
 struct AccessViolationException : Exception
@@ -1,4 +1,6 @@
 #pragma once
+#include <atomic>
+#include <cstdint>
 #include <thread>
 #include <string>
 
@@ -12,4 +14,14 @@ setThreadName(std::thread *thread,
 void
 exitThread(int result);
 
+// Blocks the calling thread while *address == expected, this may return
+//  spuriously so callers must check the value again.
+void
+waitOnAddress(std::atomic<uint32_t> *address,
+              uint32_t expected);
+
+// Wakes every thread blocked in waitOnAddress on address
+void
+wakeAllOnAddress(std::atomic<uint32_t> *address);
+
 } // namespace platform
@@ -0,0 +1,347 @@
+#include "byte_swap.h"
+#include "byte_swap_array.h"
+#include "platform.h"
+
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define BYTE_SWAP_X86
+#endif
+
+#ifdef BYTE_SWAP_X86
+#include <immintrin.h>
+
+#ifdef PLATFORM_WINDOWS
+#include <intrin.h>
+#endif
+
+// GCC and Clang only let us use intrinsics for extensions we are compiling
+//  for, so the SIMD kernels are built for their extension individually and
+//  only called once we know the host has it.  MSVC always allows them.
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSSE3
+#define TARGET_AVX2
+#endif
+#endif // BYTE_SWAP_X86
+
+struct ByteSwapKernels
+{
+   void (*swap16)(uint16_t *dst, const uint16_t *src, size_t count);
+   void (*swap32)(uint32_t *dst, const uint32_t *src, size_t count);
+   void (*swap64)(uint64_t *dst, const uint64_t *src, size_t count);
+};
+
+template<typename Type>
+static void
+copySwapScalar(Type *dst, const Type *src, size_t count)
+{
+   for (auto i = size_t { 0 }; i < count; ++i) {
+      dst[i] = byte_swap(src[i]);
+   }
+}
+
+#ifdef BYTE_SWAP_X86
+
+// PSHUFB masks which reverse the bytes of each element, repeated for both
+//  128 bit lanes as VPSHUFB does not shuffle across them.
+alignas(32) static const uint8_t
+sShuffleMask16[32] = {
+   1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+   1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+};
+
+alignas(32) static const uint8_t
+sShuffleMask32[32] = {
+   3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+   3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+};
+
+alignas(32) static const uint8_t
+sShuffleMask64[32] = {
+   7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+   7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+};
+
+template<typename Type>
+static const uint8_t *
+getShuffleMask();
+
+template<>
+const uint8_t *
+getShuffleMask<uint16_t>()
+{
+   return sShuffleMask16;
+}
+
+template<>
+const uint8_t *
+getShuffleMask<uint32_t>()
+{
+   return sShuffleMask32;
+}
+
+template<>
+const uint8_t *
+getShuffleMask<uint64_t>()
+{
+   return sShuffleMask64;
+}
+
+template<typename Type>
+TARGET_SSSE3 static void
+copySwapSSSE3(Type *dst, const Type *src, size_t count)
+{
+   const auto mask = _mm_load_si128(reinterpret_cast<const __m128i *>(getShuffleMask<Type>()));
+   const auto perVector = 16 / sizeof(Type);
+   auto out = reinterpret_cast<__m128i *>(dst);
+   auto in = reinterpret_cast<const __m128i *>(src);
+   auto i = size_t { 0 };
+
+   // Loads are all done before stores so that dst == src works
+   for (; i + perVector * 4 <= count; i += perVector * 4, in += 4, out += 4) {
+      auto a = _mm_loadu_si128(in + 0);
+      auto b = _mm_loadu_si128(in + 1);
+      auto c = _mm_loadu_si128(in + 2);
+      auto d = _mm_loadu_si128(in + 3);
+      _mm_storeu_si128(out + 0, _mm_shuffle_epi8(a, mask));
+      _mm_storeu_si128(out + 1, _mm_shuffle_epi8(b, mask));
+      _mm_storeu_si128(out + 2, _mm_shuffle_epi8(c, mask));
+      _mm_storeu_si128(out + 3, _mm_shuffle_epi8(d, mask));
+   }
+
+   for (; i + perVector <= count; i += perVector, ++in, ++out) {
+      _mm_storeu_si128(out, _mm_shuffle_epi8(_mm_loadu_si128(in), mask));
+   }
+
+   for (; i < count; ++i) {
+      dst[i] = byte_swap(src[i]);
+   }
+}
+
+template<typename Type>
+TARGET_AVX2 static void
+copySwapAVX2(Type *dst, const Type *src, size_t count)
+{
+   const auto mask = _mm256_load_si256(reinterpret_cast<const __m256i *>(getShuffleMask<Type>()));
+   const auto perVector = 32 / sizeof(Type);
+   auto out = reinterpret_cast<__m256i *>(dst);
+   auto in = reinterpret_cast<const __m256i *>(src);
+   auto i = size_t { 0 };
+
+   for (; i + perVector * 4 <= count; i += perVector * 4, in += 4, out += 4) {
+      auto a = _mm256_loadu_si256(in + 0);
+      auto b = _mm256_loadu_si256(in + 1);
+      auto c = _mm256_loadu_si256(in + 2);
+      auto d = _mm256_loadu_si256(in + 3);
+      _mm256_storeu_si256(out + 0, _mm256_shuffle_epi8(a, mask));
+      _mm256_storeu_si256(out + 1, _mm256_shuffle_epi8(b, mask));
+      _mm256_storeu_si256(out + 2, _mm256_shuffle_epi8(c, mask));
+      _mm256_storeu_si256(out + 3, _mm256_shuffle_epi8(d, mask));
+   }
+
+   for (; i + perVector <= count; i += perVector, ++in, ++out) {
+      _mm256_storeu_si256(out, _mm256_shuffle_epi8(_mm256_loadu_si256(in), mask));
+   }
+
+   // Finish with at most one 128 bit vector, then single elements
+   if (i + perVector / 2 <= count) {
+      auto in128 = reinterpret_cast<const __m128i *>(src + i);
+      auto out128 = reinterpret_cast<__m128i *>(dst + i);
+      auto mask128 = _mm256_castsi256_si128(mask);
+      _mm_storeu_si128(out128, _mm_shuffle_epi8(_mm_loadu_si128(in128), mask128));
+      i += perVector / 2;
+   }
+
+   for (; i < count; ++i) {
+      dst[i] = byte_swap(src[i]);
+   }
+
+   // Avoid the AVX to SSE transition penalty in whatever runs next
+   _mm256_zeroupper();
+}
+
+static void
+cpuid(uint32_t leaf,
+      uint32_t subleaf,
+      uint32_t regs[4])
+{
+#ifdef PLATFORM_WINDOWS
+   int cpuInfo[4];
+   __cpuidex(cpuInfo, leaf, subleaf);
+
+   for (auto i = 0; i < 4; ++i) {
+      regs[i] = static_cast<uint32_t>(cpuInfo[i]);
+   }
+#else
+   __asm__("cpuid"
+           : "=a" (regs[0]), "=b" (regs[1]), "=c" (regs[2]), "=d" (regs[3])
+           : "0" (leaf), "2" (subleaf));
+#endif
+}
+
+static uint64_t
+xgetbv(uint32_t index)
+{
+#ifdef PLATFORM_WINDOWS
+   return _xgetbv(index);
+#else
+   uint32_t eax, edx;
+   __asm__("xgetbv" : "=a" (eax), "=d" (edx) : "c" (index));
+   return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+
+#endif // BYTE_SWAP_X86
+
+static const ByteSwapKernels
+sScalarKernels = {
+   &copySwapScalar<uint16_t>,
+   &copySwapScalar<uint32_t>,
+   &copySwapScalar<uint64_t>,
+};
+
+#ifdef BYTE_SWAP_X86
+static const ByteSwapKernels
+sSSSE3Kernels = {
+   &copySwapSSSE3<uint16_t>,
+   &copySwapSSSE3<uint32_t>,
+   &copySwapSSSE3<uint64_t>,
+};
+
+static const ByteSwapKernels
+sAVX2Kernels = {
+   &copySwapAVX2<uint16_t>,
+   &copySwapAVX2<uint32_t>,
+   &copySwapAVX2<uint64_t>,
+};
+#endif
+
+static std::atomic<const ByteSwapKernels *>
+sKernels { nullptr };
+
+bool
+byte_swap_kernel_supported(ByteSwapKernel kernel)
+{
+   switch (kernel) {
+   case ByteSwapKernel::Scalar:
+      return true;
+#ifdef BYTE_SWAP_X86
+   case ByteSwapKernel::SSSE3:
+   {
+      uint32_t regs[4];
+      cpuid(1, 0, regs);
+      return !!(regs[2] & (1 << 9));
+   }
+   case ByteSwapKernel::AVX2:
+   {
+      uint32_t regs[4];
+      cpuid(0, 0, regs);
+
+      if (regs[0] < 7) {
+         return false;
+      }
+
+      // AVX2 also needs the OS to save the YMM state for us
+      cpuid(1, 0, regs);
+
+      if (!(regs[2] & (1 << 27)) || !(regs[2] & (1 << 28))) {
+         return false;
+      }
+
+      if ((xgetbv(0) & 0x6) != 0x6) {
+         return false;
+      }
+
+      cpuid(7, 0, regs);
+      return !!(regs[1] & (1 << 5));
+   }
+#endif
+   default:
+      return false;
+   }
+}
+
+static const ByteSwapKernels *
+getKernelTable(ByteSwapKernel kernel)
+{
+   switch (kernel) {
+#ifdef BYTE_SWAP_X86
+   case ByteSwapKernel::SSSE3:
+      return &sSSSE3Kernels;
+   case ByteSwapKernel::AVX2:
+      return &sAVX2Kernels;
+#endif
+   default:
+      return &sScalarKernels;
+   }
+}
+
+static const ByteSwapKernels *
+getKernels()
+{
+   auto kernels = sKernels.load(std::memory_order_acquire);
+
+   if (!kernels) {
+      // Racing threads all pick the same table, so whoever stores last is fine
+      auto best = ByteSwapKernel::Scalar;
+
+      if (byte_swap_kernel_supported(ByteSwapKernel::AVX2)) {
+         best = ByteSwapKernel::AVX2;
+      } else if (byte_swap_kernel_supported(ByteSwapKernel::SSSE3)) {
+         best = ByteSwapKernel::SSSE3;
+      }
+
+      kernels = getKernelTable(best);
+      sKernels.store(kernels, std::memory_order_release);
+   }
+
+   return kernels;
+}
+
+ByteSwapKernel
+byte_swap_kernel()
+{
+   auto kernels = getKernels();
+
+#ifdef BYTE_SWAP_X86
+   if (kernels == &sAVX2Kernels) {
+      return ByteSwapKernel::AVX2;
+   } else if (kernels == &sSSSE3Kernels) {
+      return ByteSwapKernel::SSSE3;
+   }
+#endif
+
+   return ByteSwapKernel::Scalar;
+}
+
+bool
+set_byte_swap_kernel(ByteSwapKernel kernel)
+{
+   if (!byte_swap_kernel_supported(kernel)) {
+      return false;
+   }
+
+   sKernels.store(getKernelTable(kernel), std::memory_order_release);
+   return true;
+}
+
+void
+byte_swap_copy(uint16_t *dst, const uint16_t *src, size_t count)
+{
+   getKernels()->swap16(dst, src, count);
+}
+
+void
+byte_swap_copy(uint32_t *dst, const uint32_t *src, size_t count)
+{
+   getKernels()->swap32(dst, src, count);
+}
+
+void
+byte_swap_copy(uint64_t *dst, const uint64_t *src, size_t count)
+{
+   getKernels()->swap64(dst, src, count);
+}
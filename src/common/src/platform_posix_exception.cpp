@@ -52,6 +52,18 @@ dispatchException(Exception *exception,
 
    sInSignal = true;
 
+   static const int regIndex[16] = {
+      REG_RAX, REG_RCX, REG_RDX, REG_RBX, REG_RSP, REG_RBP, REG_RSI, REG_RDI,
+      REG_R8, REG_R9, REG_R10, REG_R11, REG_R12, REG_R13, REG_R14, REG_R15,
+   };
+
+   auto &gregs = reinterpret_cast<ucontext *>(context)->uc_mcontext.gregs;
+   exception->pc = gregs[REG_RIP];
+
+   for (auto i = 0; i < 16; ++i) {
+      exception->gpr[i] = gregs[regIndex[i]];
+   }
+
    for (auto &handler : sExceptionHandlers) {
       auto func = handler(exception);
 
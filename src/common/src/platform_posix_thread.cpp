@@ -5,6 +5,12 @@
 #include <cstdlib>
 #include <pthread.h>
 
+#ifdef PLATFORM_LINUX
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 namespace platform
 {
 
@@ -26,6 +32,27 @@ exitThread(int result)
    pthread_exit(res);
 }
 
+void
+waitOnAddress(std::atomic<uint32_t> *address,
+              uint32_t expected)
+{
+#ifdef PLATFORM_LINUX
+   syscall(SYS_futex, reinterpret_cast<uint32_t *>(address), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#else
+   if (address->load() == expected) {
+      std::this_thread::yield();
+   }
+#endif
+}
+
+void
+wakeAllOnAddress(std::atomic<uint32_t> *address)
+{
+#ifdef PLATFORM_LINUX
+   syscall(SYS_futex, reinterpret_cast<uint32_t *>(address), FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+#endif
+}
+
 } // namespace platform
 
 #endif
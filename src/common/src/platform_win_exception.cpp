@@ -15,6 +15,25 @@ gExceptionHandlers;
 LONG
 dispatchException(PEXCEPTION_POINTERS info, Exception *exception)
 {
+   auto context = info->ContextRecord;
+   exception->pc = context->Rip;
+   exception->gpr[0] = context->Rax;
+   exception->gpr[1] = context->Rcx;
+   exception->gpr[2] = context->Rdx;
+   exception->gpr[3] = context->Rbx;
+   exception->gpr[4] = context->Rsp;
+   exception->gpr[5] = context->Rbp;
+   exception->gpr[6] = context->Rsi;
+   exception->gpr[7] = context->Rdi;
+   exception->gpr[8] = context->R8;
+   exception->gpr[9] = context->R9;
+   exception->gpr[10] = context->R10;
+   exception->gpr[11] = context->R11;
+   exception->gpr[12] = context->R12;
+   exception->gpr[13] = context->R13;
+   exception->gpr[14] = context->R14;
+   exception->gpr[15] = context->R15;
+
    for (auto &handler : gExceptionHandlers) {
       auto func = handler(exception);
 
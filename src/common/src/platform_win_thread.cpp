@@ -4,6 +4,8 @@
 #ifdef PLATFORM_WINDOWS
 #include <Windows.h>
 
+#pragma comment(lib, "Synchronization.lib")
+
 static const DWORD MS_VC_EXCEPTION = 0x406D1388;
 
 #pragma pack(push, 8)
@@ -46,6 +48,19 @@ exitThread(int result)
    ExitThread(result);
 }
 
+void
+waitOnAddress(std::atomic<uint32_t> *address,
+              uint32_t expected)
+{
+   WaitOnAddress(address, &expected, sizeof(expected), INFINITE);
+}
+
+void
+wakeAllOnAddress(std::atomic<uint32_t> *address)
+{
+   WakeByAddressAll(address);
+}
+
 } // namespace platform
 
 #endif
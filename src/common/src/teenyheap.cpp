@@ -0,0 +1,372 @@
+#include "align.h"
+#include "bitutils.h"
+#include "decaf_assert.h"
+#include "teenyheap.h"
+
+#include <algorithm>
+
+constexpr size_t TeenyHeap::AlignSize;
+constexpr uint32_t TeenyHeap::InvalidBlock;
+
+static inline unsigned
+highestBit(uint64_t value)
+{
+   return 63 - clz64(value);
+}
+
+static inline unsigned
+lowestBit(uint64_t value)
+{
+   return ctz64(value);
+}
+
+TeenyHeap::TeenyHeap(void *buffer, size_t size)
+{
+   // Keep every block offset a multiple of AlignSize
+   auto start = static_cast<uint8_t *>(buffer);
+   auto alignedStart = align_up(start, AlignSize);
+   auto alignedEnd = align_down(start + size, AlignSize);
+
+   mBuffer = alignedStart;
+   mSize = alignedEnd > alignedStart ? static_cast<size_t>(alignedEnd - alignedStart) : 0;
+   decaf_check(mSize < (uint64_t { 1 } << FlIndexMax));
+
+   mSlBitmap.fill(0);
+
+   for (auto &lists : mFreeLists) {
+      lists.fill(InvalidBlock);
+   }
+
+   mBlocks.reserve(InitialBlockCapacity);
+   mUnusedBlocks.reserve(InitialBlockCapacity);
+   mAllocations.reserve(InitialBlockCapacity);
+
+   if (mSize) {
+      insertFreeBlock(createBlock(0, mSize));
+   }
+}
+
+size_t
+TeenyHeap::getLargestFreeSize()
+{
+   std::unique_lock<std::mutex> lock(mMutex);
+
+   if (!mFlBitmap) {
+      return 0;
+   }
+
+   // Everything in the highest non-empty list is bigger than anything in
+   //  the lists below it, so only that one list needs looking at.
+   auto fl = highestBit(mFlBitmap);
+   auto sl = highestBit(mSlBitmap[fl]);
+   auto largest = size_t { 0 };
+
+   for (auto index = mFreeLists[fl][sl]; index != InvalidBlock; index = mBlocks[index].nextFree) {
+      largest = std::max(largest, mBlocks[index].size);
+   }
+
+   return largest;
+}
+
+size_t
+TeenyHeap::getTotalFreeSize()
+{
+   std::unique_lock<std::mutex> lock(mMutex);
+   return mTotalFreeSize;
+}
+
+TeenyHeap::Stats
+TeenyHeap::getStats()
+{
+   std::unique_lock<std::mutex> lock(mMutex);
+   return mStats;
+}
+
+void *
+TeenyHeap::alloc(size_t size, size_t alignment)
+{
+   std::unique_lock<std::mutex> lock(mMutex);
+   size = align_up(std::max<size_t>(size, 1), AlignSize);
+   alignment = std::max(alignment, AlignSize);
+   decaf_check((alignment & (alignment - 1)) == 0);
+
+   auto index = findFreeBlock(size, alignment);
+   mStats.totalAllocs++;
+
+   if (index == InvalidBlock) {
+      mStats.failedAllocs++;
+      return nullptr;
+   }
+
+   removeFreeBlock(index);
+
+   auto padding = getPadding(index, alignment);
+
+   if (padding) {
+      // The block before a free block is never free, so the padding just
+      //  becomes a free block of its own.
+      auto rest = splitBlock(index, padding);
+      insertFreeBlock(index);
+      index = rest;
+   }
+
+   if (mBlocks[index].size - size >= MinSplitSize) {
+      insertFreeBlock(splitBlock(index, size));
+   }
+
+   auto &block = mBlocks[index];
+   auto ptr = mBuffer + block.offset;
+   mAllocations.emplace(ptr, index);
+
+   mStats.usedSize += block.size;
+   mStats.peakUsedSize = std::max(mStats.peakUsedSize, mStats.usedSize);
+   mStats.numAllocations++;
+   return ptr;
+}
+
+void
+TeenyHeap::free(void *ptr)
+{
+   std::unique_lock<std::mutex> lock(mMutex);
+   auto itr = mAllocations.find(static_cast<uint8_t *>(ptr));
+   decaf_check(itr != mAllocations.end());
+
+   auto index = itr->second;
+   mAllocations.erase(itr);
+
+   mStats.usedSize -= mBlocks[index].size;
+   mStats.numAllocations--;
+
+   // Merge with whichever neighbours are free, so no two free blocks are
+   //  ever adjacent in memory.
+   auto prev = mBlocks[index].prevPhys;
+
+   if (prev != InvalidBlock && mBlocks[prev].isFree) {
+      removeFreeBlock(prev);
+      index = mergeBlocks(prev, index);
+   }
+
+   auto next = mBlocks[index].nextPhys;
+
+   if (next != InvalidBlock && mBlocks[next].isFree) {
+      removeFreeBlock(next);
+      index = mergeBlocks(index, next);
+   }
+
+   insertFreeBlock(index);
+}
+
+void
+TeenyHeap::mappingInsert(size_t size, unsigned &fl, unsigned &sl)
+{
+   if (size < SmallBlockSize) {
+      fl = 0;
+      sl = static_cast<unsigned>(size / (SmallBlockSize / SlIndexCount));
+   } else {
+      auto bit = highestBit(size);
+      sl = static_cast<unsigned>(size >> (bit - SlIndexCountLog2)) ^ SlIndexCount;
+      fl = bit - (FlIndexShift - 1);
+   }
+}
+
+bool
+TeenyHeap::mappingSearch(size_t size, unsigned &fl, unsigned &sl)
+{
+   // Round up to the next list boundary so any block we find will fit
+   if (size >= SmallBlockSize) {
+      size += (size_t { 1 } << (highestBit(size) - SlIndexCountLog2)) - 1;
+   }
+
+   mappingInsert(size, fl, sl);
+   return fl < FlIndexCount;
+}
+
+uint32_t
+TeenyHeap::createBlock(size_t offset, size_t size)
+{
+   auto index = uint32_t { 0 };
+
+   if (!mUnusedBlocks.empty()) {
+      index = mUnusedBlocks.back();
+      mUnusedBlocks.pop_back();
+   } else {
+      index = static_cast<uint32_t>(mBlocks.size());
+      mBlocks.emplace_back();
+   }
+
+   auto &block = mBlocks[index];
+   block.offset = offset;
+   block.size = size;
+   block.prevPhys = InvalidBlock;
+   block.nextPhys = InvalidBlock;
+   block.prevFree = InvalidBlock;
+   block.nextFree = InvalidBlock;
+   block.isFree = false;
+   return index;
+}
+
+void
+TeenyHeap::destroyBlock(uint32_t index)
+{
+   mUnusedBlocks.push_back(index);
+}
+
+void
+TeenyHeap::insertFreeBlock(uint32_t index)
+{
+   unsigned fl, sl;
+   auto &block = mBlocks[index];
+   mappingInsert(block.size, fl, sl);
+
+   auto &head = mFreeLists[fl][sl];
+   block.isFree = true;
+   block.prevFree = InvalidBlock;
+   block.nextFree = head;
+
+   if (head != InvalidBlock) {
+      mBlocks[head].prevFree = index;
+   }
+
+   head = index;
+   mFlBitmap |= 1u << fl;
+   mSlBitmap[fl] |= 1u << sl;
+
+   mTotalFreeSize += block.size;
+   mStats.numFreeBlocks++;
+}
+
+void
+TeenyHeap::removeFreeBlock(uint32_t index)
+{
+   unsigned fl, sl;
+   auto &block = mBlocks[index];
+   mappingInsert(block.size, fl, sl);
+   decaf_check(block.isFree);
+
+   if (block.prevFree != InvalidBlock) {
+      mBlocks[block.prevFree].nextFree = block.nextFree;
+   } else {
+      mFreeLists[fl][sl] = block.nextFree;
+   }
+
+   if (block.nextFree != InvalidBlock) {
+      mBlocks[block.nextFree].prevFree = block.prevFree;
+   }
+
+   if (mFreeLists[fl][sl] == InvalidBlock) {
+      mSlBitmap[fl] &= ~(1u << sl);
+
+      if (!mSlBitmap[fl]) {
+         mFlBitmap &= ~(1u << fl);
+      }
+   }
+
+   block.isFree = false;
+   block.prevFree = InvalidBlock;
+   block.nextFree = InvalidBlock;
+
+   mTotalFreeSize -= block.size;
+   mStats.numFreeBlocks--;
+}
+
+
+/**
+ * Shrink a block to size, moving the rest of it into a new block which
+ * follows it in memory.  Returns the new block.
+ */
+uint32_t
+TeenyHeap::splitBlock(uint32_t index, size_t size)
+{
+   // createBlock may reallocate mBlocks, so no references across it
+   auto rest = createBlock(mBlocks[index].offset + size, mBlocks[index].size - size);
+   auto next = mBlocks[index].nextPhys;
+
+   mBlocks[rest].prevPhys = index;
+   mBlocks[rest].nextPhys = next;
+
+   if (next != InvalidBlock) {
+      mBlocks[next].prevPhys = rest;
+   }
+
+   mBlocks[index].nextPhys = rest;
+   mBlocks[index].size = size;
+   return rest;
+}
+
+
+/**
+ * Absorb next into prev, which must be directly before it in memory.
+ */
+uint32_t
+TeenyHeap::mergeBlocks(uint32_t prev, uint32_t next)
+{
+   auto nextNext = mBlocks[next].nextPhys;
+   decaf_check(mBlocks[prev].nextPhys == next);
+
+   mBlocks[prev].size += mBlocks[next].size;
+   mBlocks[prev].nextPhys = nextNext;
+
+   if (nextNext != InvalidBlock) {
+      mBlocks[nextNext].prevPhys = prev;
+   }
+
+   destroyBlock(next);
+   return prev;
+}
+
+size_t
+TeenyHeap::getPadding(uint32_t index, size_t alignment)
+{
+   auto start = mBuffer + mBlocks[index].offset;
+   return static_cast<size_t>(align_up(start, alignment) - start);
+}
+
+uint32_t
+TeenyHeap::findFreeBlock(size_t size, size_t alignment)
+{
+   // Block starts are AlignSize aligned so we never pad by more than this,
+   //  any block big enough for size + maxPadding fits wherever it starts.
+   auto maxPadding = alignment - AlignSize;
+   unsigned fl, sl;
+
+   if (mappingSearch(size + maxPadding, fl, sl)) {
+      auto slMap = mSlBitmap[fl] & (~0u << sl);
+
+      if (!slMap) {
+         auto flMap = fl + 1 < FlIndexCount ? (mFlBitmap & (~0u << (fl + 1))) : 0u;
+
+         if (flMap) {
+            fl = lowestBit(flMap);
+            slMap = mSlBitmap[fl];
+         }
+      }
+
+      if (slMap) {
+         return mFreeLists[fl][lowestBit(slMap)];
+      }
+   }
+
+   // Rounding up and assuming the worst case padding skips blocks which
+   //  may still fit, e.g. an already aligned block of exactly size.  Check
+   //  the real padding of every block which could hold size.  Only reached
+   //  when the heap is nearly full, but it stops us failing allocations the
+   //  old first fit heap would make.
+   mappingInsert(size, fl, sl);
+
+   for (; fl < FlIndexCount; ++fl, sl = 0) {
+      auto slMap = mSlBitmap[fl] & (~0u << sl);
+
+      while (slMap) {
+         auto list = lowestBit(slMap);
+         slMap &= slMap - 1;
+
+         for (auto index = mFreeLists[fl][list]; index != InvalidBlock; index = mBlocks[index].nextFree) {
+            if (mBlocks[index].size >= size + getPadding(index, alignment)) {
+               return index;
+            }
+         }
+      }
+   }
+
+   return InvalidBlock;
+}
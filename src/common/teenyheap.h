@@ -1,129 +1,158 @@
 #pragma once
-#include "align.h"
-#include "decaf_assert.h"
-#include <algorithm>
-#include <map>
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <mutex>
+#include <unordered_map>
 #include <vector>
 
+/**
+ * A two level segregated fit (TLSF) allocator over a caller provided buffer.
+ *
+ * Free blocks are kept in lists indexed by a first level (power of two) and
+ * second level (linear subdivision of that power of two) size class, with a
+ * bitmap for each level, so finding a free block and returning one are both
+ * constant time.
+ *
+ * The buffer is usually guest memory, so all block bookkeeping lives on the
+ * host and nothing is ever written into the buffer itself.
+ */
 class TeenyHeap
 {
-private:
-   struct MemoryBlock
+public:
+   struct Stats
    {
-      uint8_t *start;
-      size_t size;
+      //! Bytes currently allocated, including any remainder too small to
+      //!  split off the end of a block.  Leading alignment padding goes back
+      //!  to the free list so is not counted.
+      size_t usedSize = 0;
+
+      //! Highest value usedSize has reached
+      size_t peakUsedSize = 0;
+
+      //! Number of live allocations
+      size_t numAllocations = 0;
+
+      //! Number of blocks in the free lists
+      size_t numFreeBlocks = 0;
+
+      //! Total number of alloc calls which succeeded or failed
+      uint64_t totalAllocs = 0;
+      uint64_t failedAllocs = 0;
    };
 
 public:
-   TeenyHeap(void *buffer, size_t size) :
-      mBuffer(static_cast<uint8_t *>(buffer)),
-      mSize(size)
-   {
-      mFreeBlocks.emplace_back(MemoryBlock { mBuffer, mSize });
-   }
+   TeenyHeap(void *buffer, size_t size);
 
    size_t
-   getLargestFreeSize()
-   {
-      auto largest = size_t { 0 };
+   getLargestFreeSize();
 
-      for (auto &block : mFreeBlocks) {
-         largest = std::max(largest, block.size);
-      }
+   size_t
+   getTotalFreeSize();
 
-      return largest;
-   }
+   Stats
+   getStats();
 
-   size_t
-   getTotalFreeSize()
-   {
-      auto total = size_t { 0 };
+   void *
+   alloc(size_t size, size_t alignment = 4);
+
+   void
+   free(void *ptr);
 
-      for (auto &block : mFreeBlocks) {
-         total += block.size;
-      }
+private:
+   // Every block size and offset is a multiple of this
+   static constexpr unsigned AlignSizeLog2 = 2;
+   static constexpr size_t AlignSize = 1 << AlignSizeLog2;
 
-      return total;
-   }
+   // Number of second level lists per power of two
+   static constexpr unsigned SlIndexCountLog2 = 5;
+   static constexpr unsigned SlIndexCount = 1 << SlIndexCountLog2;
 
-   void *
-   alloc(size_t size, size_t alignment = 4)
+   // Sizes below SmallBlockSize all share first level 0
+   static constexpr unsigned FlIndexShift = SlIndexCountLog2 + AlignSizeLog2;
+   static constexpr size_t SmallBlockSize = size_t { 1 } << FlIndexShift;
+
+   // Largest block is below 2^FlIndexMax, enough for any guest memory region
+   static constexpr unsigned FlIndexMax = 32;
+   static constexpr unsigned FlIndexCount = FlIndexMax - FlIndexShift + 1;
+
+   // Splitting off anything smaller than this is not worth a block
+   static constexpr size_t MinSplitSize = 16;
+
+   static constexpr uint32_t InvalidBlock = 0xFFFFFFFF;
+
+   // Number of blocks / allocations to reserve room for up front, so the
+   //  host containers rarely have to grow in the middle of an alloc
+   static constexpr size_t InitialBlockCapacity = 1024;
+
+   struct Block
    {
-      std::unique_lock<std::mutex> lock(mMutex);
-      auto adjSize = size;
-      auto block = mFreeBlocks.begin();
-
-      for (block = mFreeBlocks.begin(); block != mFreeBlocks.end(); ++block) {
-         auto alignedDiff = align_up(block->start, alignment) - block->start;
-         if (block->size - alignedDiff >= adjSize) {
-            adjSize += alignedDiff;
-            break;
-         }
-      }
-
-      if (block == mFreeBlocks.end()) {
-         return nullptr;
-      }
-
-      auto start = block->start;
-      block->start += adjSize;
-      block->size -= adjSize;
-
-      // Erase block if it gets too small
-      if (block->size <= sizeof(MemoryBlock) + 4) {
-         adjSize += block->size;
-         mFreeBlocks.erase(block);
-      }
-
-      // Allocate block
-      auto alignedStart = align_up(start, alignment);
-      mAllocatedBlocks.emplace(alignedStart, MemoryBlock { start, adjSize });
-
-      return alignedStart;
-   }
+      size_t offset;
+      size_t size;
+
+      //! Neighbours in memory, InvalidBlock at either end of the buffer
+      uint32_t prevPhys;
+      uint32_t nextPhys;
+
+      //! Neighbours in this block's free list
+      uint32_t prevFree;
+      uint32_t nextFree;
+
+      bool isFree;
+   };
+
+   static void
+   mappingInsert(size_t size, unsigned &fl, unsigned &sl);
+
+   static bool
+   mappingSearch(size_t size, unsigned &fl, unsigned &sl);
+
+   uint32_t
+   createBlock(size_t offset, size_t size);
 
    void
-   free(void *ptr)
-   {
-      std::unique_lock<std::mutex> lock(mMutex);
-      auto ucptr = static_cast<uint8_t*>(ptr);
-      auto itr = mAllocatedBlocks.find(ucptr);
-      decaf_check(itr != mAllocatedBlocks.end());
+   destroyBlock(uint32_t index);
 
-      releaseBlock(itr->second);
-      mAllocatedBlocks.erase(itr);
-   }
+   void
+   insertFreeBlock(uint32_t index);
 
-protected:
    void
-   releaseBlock(MemoryBlock block)
-   {
-      auto blockStart = block.start;
-      auto blockEnd = block.start + block.size;
+   removeFreeBlock(uint32_t index);
 
-      for (auto &free : mFreeBlocks) {
-         auto freeStart = free.start;
-         auto freeEnd = free.start + free.size;
+   uint32_t
+   splitBlock(uint32_t index, size_t size);
 
-         if (blockStart == freeEnd) {
-            free.size += block.size;
-            return;
-         }
+   uint32_t
+   mergeBlocks(uint32_t prev, uint32_t next);
 
-         if (blockEnd == freeStart) {
-            free.start = blockStart;
-            free.size += block.size;
-            return;
-         }
-      }
+   size_t
+   getPadding(uint32_t index, size_t alignment);
 
-      mFreeBlocks.emplace_back(block);
-   }
+   uint32_t
+   findFreeBlock(size_t size, size_t alignment);
 
+private:
+   std::mutex mMutex;
    uint8_t *mBuffer;
    size_t mSize;
-   std::vector<MemoryBlock> mFreeBlocks;
-   std::map<uint8_t *, MemoryBlock> mAllocatedBlocks;
-   std::mutex mMutex;
+
+   //! Host side block storage, indexed by block number
+   std::vector<Block> mBlocks;
+
+   //! Entries of mBlocks which are not in use
+   std::vector<uint32_t> mUnusedBlocks;
+
+   //! Allocated pointer to the block which holds it
+   std::unordered_map<uint8_t *, uint32_t> mAllocations;
+
+   //! Bit n set when any second level list of first level n is not empty
+   uint32_t mFlBitmap = 0;
+
+   //! Bit n of entry f set when mFreeLists[f][n] is not empty
+   std::array<uint32_t, FlIndexCount> mSlBitmap;
+
+   std::array<std::array<uint32_t, SlIndexCount>, FlIndexCount> mFreeLists;
+
+   size_t mTotalFreeSize = 0;
+   Stats mStats;
 };
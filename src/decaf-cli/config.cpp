@@ -46,6 +46,7 @@ struct CerealLog
          CEREAL_NVP(to_file),
          CEREAL_NVP(to_stdout),
          CEREAL_NVP(kernel_trace),
+         CEREAL_NVP(trace_ring_size),
          CEREAL_NVP(level));
    }
 };
@@ -57,7 +58,13 @@ struct CerealJit
    {
       using namespace decaf::config::jit;
       ar(CEREAL_NVP(enabled),
-         CEREAL_NVP(verify));
+         CEREAL_NVP(verify),
+         CEREAL_NVP(tiered),
+         CEREAL_NVP(cache_path),
+         CEREAL_NVP(profile),
+         CEREAL_NVP(perf_map),
+         CEREAL_NVP(host_extensions),
+         CEREAL_NVP(trace_ring));
    }
 };
 
@@ -81,6 +88,7 @@ struct CerealSystem
       ar(CEREAL_NVP(region),
          CEREAL_NVP(mlc_path),
          CEREAL_NVP(sdcard_path),
+         CEREAL_NVP(virtual_time),
          CEREAL_NVP(timeout_ms));
    }
 };
@@ -70,6 +70,8 @@ getCommandLineParser()
       .add_option("time-scale",
                   description { "Time scale factor for emulated clock." },
                   default_value<double> { 1.0 })
+      .add_option("virtual-time",
+                  description { "Advance the emulated clock by guest instructions executed, for repeatable runs." })
       .add_option("timeout_ms",
                   description { "How long to execute the game for before quitting." },
                   value<uint32_t> {});
@@ -183,6 +185,10 @@ start(excmd::parser &parser,
       decaf::config::system::time_scale = options.get<double>("time-scale");
    }
 
+   if (options.has("virtual-time")) {
+      decaf::config::system::virtual_time = true;
+   }
+
    if (options.has("timeout_ms")) {
       config::system::timeout_ms = options.get<uint32_t>("timeout_ms");
    }
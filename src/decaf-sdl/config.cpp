@@ -175,6 +175,7 @@ struct CerealLog
          CEREAL_NVP(kernel_trace_res),
          CEREAL_NVP(kernel_trace_filters),
          CEREAL_NVP(branch_trace),
+         CEREAL_NVP(trace_ring_size),
          CEREAL_NVP(level));
    }
 };
@@ -186,7 +187,13 @@ struct CerealJit
    {
       using namespace decaf::config::jit;
       ar(CEREAL_NVP(enabled),
-         CEREAL_NVP(verify));
+         CEREAL_NVP(verify),
+         CEREAL_NVP(tiered),
+         CEREAL_NVP(cache_path),
+         CEREAL_NVP(profile),
+         CEREAL_NVP(perf_map),
+         CEREAL_NVP(host_extensions),
+         CEREAL_NVP(trace_ring));
    }
 };
 
@@ -210,7 +217,8 @@ struct CerealSystem
       using namespace decaf::config::system;
       ar(CEREAL_NVP(region),
          CEREAL_NVP(mlc_path),
-         CEREAL_NVP(sdcard_path));
+         CEREAL_NVP(sdcard_path),
+         CEREAL_NVP(virtual_time));
    }
 };
 
@@ -111,7 +111,9 @@ getCommandLineParser()
                   value<std::string> {})
       .add_option("time-scale",
                   description { "Time scale factor for emulated clock." },
-                  default_value<double> { 1.0 });
+                  default_value<double> { 1.0 })
+      .add_option("virtual-time",
+                  description { "Advance the emulated clock by guest instructions executed, for repeatable runs." });
 
    parser.add_command("play")
       .add_option_group(gpu_options)
@@ -284,6 +286,10 @@ start(excmd::parser &parser,
       decaf::config::system::time_scale = options.get<double>("time-scale");
    }
 
+   if (options.has("virtual-time")) {
+      decaf::config::system::virtual_time = true;
+   }
+
    auto gamePath = options.get<std::string>("game directory");
    auto logFile = config::log::directory + "/" + getPathBasename(gamePath);
    auto logLevel = spdlog::level::info;
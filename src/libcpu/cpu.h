@@ -5,7 +5,9 @@
 #include <cstdint>
 #include <functional>
 #include <libcpu/mem.h>
+#include <string>
 #include <utility>
+#include <vector>
 
 struct Tracer;
 
@@ -30,7 +32,8 @@ const uint32_t InvalidCoreId = 0xFF;
 enum class jit_mode {
    disabled,
    enabled,
-   verify
+   verify,
+   tiered
 };
 
 static const uint32_t CALLBACK_ADDR = 0xFBADCDE0;
@@ -41,6 +44,7 @@ using SegfaultHandler = void(*)(uint32_t address);
 using IllInstHandler = void(*)();
 using BranchTraceHandler = void(*)(uint32_t target);
 using KernelCallFunction = void(*)(Core *state, void *userData);
+using SymbolNameHandler = std::string(*)(ppcaddr_t address);
 
 struct KernelCallEntry
 {
@@ -48,12 +52,26 @@ struct KernelCallEntry
    void *user_data;
 };
 
+struct JitBlockProfile
+{
+   ppcaddr_t start;
+   ppcaddr_t end;
+   uint64_t entries;
+};
+
 void
 initialise();
 
 void
 setJitMode(jit_mode mode);
 
+void
+setVirtualTime(bool enabled);
+
+void
+invalidateInstructionCache(ppcaddr_t address,
+                           uint32_t size);
+
 void
 setCoreEntrypointHandler(EntrypointHandler handler);
 
@@ -69,6 +87,9 @@ setIllInstHandler(IllInstHandler handler);
 void
 setBranchTraceHandler(BranchTraceHandler handler);
 
+void
+setSymbolNameHandler(SymbolNameHandler handler);
+
 uint32_t
 registerKernelCall(const KernelCallEntry &entry);
 
@@ -110,6 +131,41 @@ removeBreakpoint(ppcaddr_t address,
 uint64_t *
 getJitFallbackStats();
 
+void
+setJitCacheDirectory(const std::string &path);
+
+void
+addJitCacheRegion(ppcaddr_t start,
+                  uint32_t size);
+
+void
+saveJitCache();
+
+void
+setJitHostExtensions(bool enabled);
+
+void
+setJitProfiling(bool enabled);
+
+void
+setJitPerfMap(bool enabled);
+
+void
+setJitTraceRing(bool enabled);
+
+void
+setTraceRingSize(size_t records);
+
+bool
+saveTraceRing(uint32_t coreId,
+              const std::string &path);
+
+std::vector<JitBlockProfile>
+getJitProfile();
+
+void
+resetJitProfile();
+
 namespace this_core
 {
 
@@ -140,6 +196,12 @@ clearInterrupt(uint32_t flags);
 void
 setNextAlarm(std::chrono::steady_clock::time_point alarm_time);
 
+// In virtual time mode the cores' time bases drift apart, this moves the
+//  current core forward to at least tb so a thread resumed on it never sees
+//  time go backwards.  Does nothing when using the host clock.
+void
+syncTimeBase(uint64_t tb);
+
 cpu::Core *
 state();
 
@@ -3,72 +3,47 @@
 #include <common/bitutils.h>
 #include <common/decaf_assert.h>
 #include <algorithm>
+#include <array>
+#include <memory>
 
 namespace espresso
 {
 
-struct TableEntry
-{
-   struct FieldMap
-   {
-      InstructionField field;
-      std::vector<TableEntry> children;
-   };
-
-   void
-   addInstruction(InstructionField field, uint32_t value, InstructionInfo *instrInfo)
-   {
-      auto fieldMap = getFieldMap(field);
-      decaf_check(fieldMap);
-      decaf_check(value < fieldMap->children.size());
-      fieldMap->children[value].instr = instrInfo;
-   }
-
-   void
-   addTable(InstructionField field)
-   {
-      if (!getFieldMap(field)) {
-         auto fieldMap = FieldMap {};
-         auto size = 1 << getInstructionFieldWidth(field);
-         fieldMap.field = field;
-         fieldMap.children.resize(size);
-         fieldMaps.emplace_back(fieldMap);
-      }
-   }
+static std::vector<InstructionInfo>
+sInstructionInfo;
 
-   TableEntry *
-   getEntry(InstructionField field, uint32_t value)
-   {
-      auto fieldMap = getFieldMap(field);
-      decaf_check(fieldMap);
-      decaf_check(value < fieldMap->children.size());
-      return &fieldMap->children[value];
-   }
+static std::vector<InstructionAlias>
+sAliasData;
 
-   FieldMap *
-   getFieldMap(InstructionField field)
-   {
-      for (auto &fieldMap : fieldMaps) {
-         if (fieldMap.field == field) {
-            return &fieldMap;
-         }
-      }
+// Instructions are decoded with a table indexed by the primary opcode and,
+//  for opcodes with extended forms, a second table indexed by the extended
+//  opcode bits 21-30.  The found instruction is then checked against the
+//  full set of opcode bits to reject invalid encodings.
+static const uint32_t ExtendedOpcodeShift = 1;
+static const uint32_t ExtendedOpcodeMask = 0x3FF;
 
-      return nullptr;
-   }
+using ExtendedTable = std::array<InstructionInfo *, ExtendedOpcodeMask + 1>;
 
+struct PrimaryTableEntry
+{
    InstructionInfo *instr = nullptr;
-   std::vector<FieldMap> fieldMaps;
+   ExtendedTable *extended = nullptr;
 };
 
-static std::vector<InstructionInfo>
-sInstructionInfo;
+struct OpcodeBits
+{
+   uint32_t mask;
+   uint32_t value;
+};
 
-static std::vector<InstructionAlias>
-sAliasData;
+static std::array<PrimaryTableEntry, 64>
+sPrimaryTable;
+
+static std::vector<std::unique_ptr<ExtendedTable>>
+sExtendedTables;
 
-static TableEntry
-sInstructionTable;
+static std::vector<OpcodeBits>
+sOpcodeBits;
 
 #define FLD(x, y, z, ...) {y, z},
 #define MRKR(x, ...) {-1, -1},
@@ -165,24 +140,24 @@ encodeSPR(Instruction &instr, SPR spr)
 InstructionInfo *
 decodeInstruction(Instruction instr)
 {
-   auto table = &sInstructionTable;
+   auto &primary = sPrimaryTable[instr.opcd];
+   auto info = primary.instr;
 
-   while (table) {
-      for (auto &fieldMap : table->fieldMaps) {
-         auto value = getInstructionFieldValue(fieldMap.field, instr);
-         table = &fieldMap.children[value];
+   if (primary.extended) {
+      info = (*primary.extended)[(instr.value >> ExtendedOpcodeShift) & ExtendedOpcodeMask];
+   }
 
-         if (table->instr || table->fieldMaps.size()) {
-            break;
-         }
-      }
+   if (!info) {
+      return nullptr;
+   }
 
-      if (table->fieldMaps.size() == 0) {
-         return table->instr;
-      }
+   auto &bits = sOpcodeBits[static_cast<size_t>(info->id)];
+
+   if ((instr.value & bits.mask) != bits.value) {
+      return nullptr;
    }
 
-   return nullptr;
+   return info;
 }
 
 // Encode specified instruction
@@ -259,22 +234,45 @@ isA(InstructionID id, Instruction instr)
 static void
 initialiseInstructionTable()
 {
+   const auto extendedBits = ExtendedOpcodeMask << ExtendedOpcodeShift;
+   sOpcodeBits.resize(sInstructionInfo.size());
+
    for (auto &instr : sInstructionInfo) {
-      TableEntry *table = &sInstructionTable;
-
-      // Resolve opcodes
-      for (auto i = 0u; i < instr.opcode.size() - 1; ++i) {
-         auto field = instr.opcode[i].field;
-         auto value = instr.opcode[i].value;
-         table->addTable(field);
-         table = table->getEntry(field, value);
+      auto &bits = sOpcodeBits[static_cast<size_t>(instr.id)];
+      bits = OpcodeBits { 0, 0 };
+
+      for (auto &op : instr.opcode) {
+         bits.mask |= getInstructionFieldBitmask(op.field);
+         bits.value |= op.value << getInstructionFieldStart(op.field);
       }
 
-      // Add the actual instruction entry
-      auto field = instr.opcode.back().field;
-      auto value = instr.opcode.back().value;
-      table->addTable(instr.opcode.back().field);
-      table->addInstruction(field, value, &instr);
+      decaf_check((bits.mask & 0xFC000000) == 0xFC000000);
+      auto &primary = sPrimaryTable[bits.value >> 26];
+
+      if (!(bits.mask & extendedBits)) {
+         decaf_check(!primary.instr && !primary.extended);
+         primary.instr = &instr;
+         continue;
+      }
+
+      decaf_check(!primary.instr);
+
+      if (!primary.extended) {
+         sExtendedTables.emplace_back(std::make_unique<ExtendedTable>());
+         primary.extended = sExtendedTables.back().get();
+         primary.extended->fill(nullptr);
+      }
+
+      // Fill every extended opcode slot which this instruction matches
+      for (auto i = 0u; i <= ExtendedOpcodeMask; ++i) {
+         auto slotBits = i << ExtendedOpcodeShift;
+
+         if ((slotBits & bits.mask) == (bits.value & extendedBits & bits.mask)) {
+            auto &slot = (*primary.extended)[i];
+            decaf_check(!slot);
+            slot = &instr;
+         }
+      }
    }
 }
 
@@ -363,6 +361,19 @@ initialiseInstructionSet()
    // Populate sInstructionAlias
 #  include "espresso_instruction_aliases.inl"
 
+   for (auto &info : sInstructionInfo) {
+      auto isFpr = [](InstructionField field) {
+         return field == InstructionField::frA
+             || field == InstructionField::frB
+             || field == InstructionField::frC
+             || field == InstructionField::frD
+             || field == InstructionField::frS;
+      };
+
+      info.usesFpr = std::any_of(info.read.begin(), info.read.end(), isFpr)
+                  || std::any_of(info.write.begin(), info.write.end(), isFpr);
+   }
+
    // Create instruction table
    initialiseInstructionTable();
 };
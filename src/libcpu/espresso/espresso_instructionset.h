@@ -51,6 +51,9 @@ struct InstructionInfo
    std::vector<InstructionField> read;
    std::vector<InstructionField> write;
    std::vector<InstructionField> flags;
+
+   // True if any read or write field is a floating point register
+   bool usesFpr;
 };
 
 struct InstructionAlias
@@ -103,4 +106,8 @@ getInstructionFieldWidth(InstructionField field);
 uint32_t
 getInstructionFieldBitmask(InstructionField field);
 
+uint32_t
+getInstructionFieldValue(const InstructionField& field,
+                         Instruction instr);
+
 } // namespace espresso
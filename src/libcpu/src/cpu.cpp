@@ -20,9 +20,6 @@ namespace cpu
 std::atomic_bool
 gRunning;
 
-std::chrono::time_point<std::chrono::steady_clock>
-sStartupTime;
-
 EntrypointHandler
 gCoreEntryPointHandler;
 
@@ -53,8 +50,7 @@ initialise()
    espresso::initialiseInstructionSet();
    cpu::interpreter::initialise();
    cpu::jit::initialise();
-
-   sStartupTime = std::chrono::steady_clock::now();
+   initialiseTimeBase();
 }
 
 void
@@ -63,6 +59,17 @@ setJitMode(jit_mode mode)
    gJitMode = mode;
 }
 
+void
+invalidateInstructionCache(ppcaddr_t address,
+                           uint32_t size)
+{
+   interpreter::invalidateRange(address, size);
+
+   if (gJitMode != jit_mode::disabled) {
+      jit::invalidateRange(address, size);
+   }
+}
+
 static void
 coreSegfaultEntry()
 {
@@ -77,11 +84,28 @@ coreIllInstEntry()
    decaf_abort("The CPU illegal instruction handler must never return.");
 }
 
+// Generated code does not keep nia up to date, so find which guest
+//  instruction the fault came from using the JIT's address maps.
+static void
+recoverFaultAddress(platform::Exception *exception)
+{
+   auto core = this_core::state();
+   auto cia = uint32_t { 0 };
+
+   if (core && gJitMode != jit_mode::disabled
+    && jit::findGuestAddress(reinterpret_cast<void *>(exception->pc), cia)) {
+      core->cia = cia;
+      core->nia = cia + 4;
+      jit::recoverPinnedRegisters(core, exception->gpr);
+   }
+}
+
 static platform::ExceptionResumeFunc
 exceptionHandler(platform::Exception *exception)
 {
    // Handle illegal instructions!
    if (exception->type == platform::Exception::InvalidInstruction) {
+      recoverFaultAddress(exception);
       return coreIllInstEntry;
    }
 
@@ -106,6 +130,7 @@ exceptionHandler(platform::Exception *exception)
    }
 
    sSegfaultAddr = static_cast<uint32_t>(address - memBase);
+   recoverFaultAddress(exception);
    return coreSegfaultEntry;
 }
 
@@ -159,6 +184,9 @@ join()
    // Mark the CPU as no longer running
    gRunning.store(false);
 
+   // Stop the background JIT compiler
+   jit::shutdown();
+
    // Notify the timer thread that something changed
    gTimerCondition.notify_all();
 
@@ -200,22 +228,6 @@ setBranchTraceHandler(BranchTraceHandler handler)
    gBranchTraceHandler = handler;
 }
 
-std::chrono::steady_clock::time_point
-tbToTimePoint(uint64_t ticks)
-{
-   auto cpuTicks = TimerDuration(ticks);
-   auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(cpuTicks);
-   return sStartupTime + nanos;
-}
-
-uint64_t
-Core::tb()
-{
-   auto now = std::chrono::steady_clock::now();
-   auto ticks = std::chrono::duration_cast<TimerDuration>(now - sStartupTime);
-   return ticks.count();
-}
-
 namespace this_core
 {
 
@@ -250,7 +262,13 @@ executeSub()
 {
    auto lr = tCurrentCore->lr;
    tCurrentCore->lr = CALLBACK_ADDR;
-   resume();
+
+   if (gJitMode != jit_mode::disabled && !hasBreakpoints()) {
+      jit::resumeSub();
+   } else {
+      resume();
+   }
+
    tCurrentCore->lr = lr;
 }
 
@@ -262,6 +280,15 @@ updateRoundingMode()
    static const int modes[4] = {
       FE_TONEAREST, FE_TOWARDZERO, FE_UPWARD, FE_DOWNWARD
    };
+
+   // fesetround is comparatively slow and this is called on every
+   //  host to guest call, so skip it when the mode has not changed.  We
+   //  ask the host rather than remembering the last mode we set because
+   //  fiber switches restore the control words of the resumed fiber.
+   if (fegetround() == modes[core->fpscr.rn]) {
+      return;
+   }
+
    fesetround(modes[core->fpscr.rn]);
 }
 
@@ -1,24 +1,101 @@
 #include <common/decaf_assert.h>
 #include "cpu.h"
+#include "cpu_internal.h"
 #include "mem.h"
 
 #include <atomic>
 #include <cstring>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 namespace cpu
 {
 
+std::atomic<std::atomic<uint64_t> *>
+gBreakpointPages[BreakpointPageCount];
+
 static std::atomic<uint32_t*>
 gBreakpoints;
 
+// Serialises changes so the bitmap always matches the list
+static std::mutex
+sBreakpointMutex;
+
 using BreakpointListFn = std::function<uint32_t * (uint32_t*)>;
 
+static bool
+listHasBreakpoint(uint32_t *bpList, ppcaddr_t address)
+{
+   if (!bpList) {
+      return false;
+   }
+
+   for (auto *bpListIter = bpList; *bpListIter != 0xFFFFFFFF; bpListIter += 2) {
+      if (bpListIter[0] == address) {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+static void
+setBreakpointBit(ppcaddr_t address, bool set)
+{
+   auto &pageRef = gBreakpointPages[address >> BreakpointPageShift];
+   auto page = pageRef.load(std::memory_order_acquire);
+
+   if (!page) {
+      if (!set) {
+         return;
+      }
+
+      // Pages are never freed as the cores may be reading them
+      page = new std::atomic<uint64_t>[BreakpointPageWords];
+
+      for (auto i = 0u; i < BreakpointPageWords; ++i) {
+         page[i].store(0, std::memory_order_relaxed);
+      }
+
+      pageRef.store(page, std::memory_order_release);
+   }
+
+   auto index = (address & ((1 << BreakpointPageShift) - 1)) >> 2;
+   auto bit = UINT64_C(1) << (index % 64);
+
+   if (set) {
+      page[index / 64].fetch_or(bit);
+   } else {
+      page[index / 64].fetch_and(~bit);
+   }
+}
+
+static void
+syncBreakpointBits(uint32_t *oldList, uint32_t *newList)
+{
+   // Set the new bits before clearing old ones so a breakpoint which is in
+   //  both lists is never missed by a core checking concurrently.
+   if (newList) {
+      for (auto *bpListIter = newList; *bpListIter != 0xFFFFFFFF; bpListIter += 2) {
+         setBreakpointBit(bpListIter[0], true);
+      }
+   }
+
+   if (oldList) {
+      for (auto *bpListIter = oldList; *bpListIter != 0xFFFFFFFF; bpListIter += 2) {
+         if (!listHasBreakpoint(newList, bpListIter[0])) {
+            setBreakpointBit(bpListIter[0], false);
+         }
+      }
+   }
+}
+
 static inline void
 compareAndSwapBreakpoints(uint32_t *bpList, BreakpointListFn functor)
 {
+   std::unique_lock<std::mutex> lock { sBreakpointMutex };
    uint32_t *newBpList = nullptr;
 
    do {
@@ -29,6 +106,8 @@ compareAndSwapBreakpoints(uint32_t *bpList, BreakpointListFn functor)
          return;
       }
    } while (!gBreakpoints.compare_exchange_strong(bpList, newBpList));
+
+   syncBreakpointBits(bpList, newBpList);
 }
 
 static inline bool
@@ -210,6 +289,10 @@ hasBreakpoints()
 bool
 popBreakpoint(ppcaddr_t address)
 {
+   if (!hasBreakpoint(address)) {
+      return false;
+   }
+
    auto bpList = gBreakpoints.load(std::memory_order_acquire);
 
    if (bpList == nullptr) {
@@ -1,8 +1,12 @@
 #pragma once
 #include "cpu.h"
+#include "espresso/espresso_instructionset.h"
 #include "mem.h"
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
 
 namespace cpu
 {
@@ -25,21 +29,74 @@ gBranchTraceHandler;
 extern jit_mode
 gJitMode;
 
+extern bool
+gVirtualTime;
+
+// Guest instructions per time base tick when running in virtual time
+static const uint64_t VirtualTimeInstructionsPerTick = coreClockSpeed / timerClockSpeed;
+
 extern std::condition_variable
 gTimerCondition;
 
 extern std::thread
 gTimerThread;
 
+// Breakpoint addresses are also tracked in a bitmap of 1MB pages so the
+//  cores can check for one without walking the breakpoint list.
+static const uint32_t BreakpointPageShift = 20;
+static const uint32_t BreakpointPageCount = 1 << (32 - BreakpointPageShift);
+static const uint32_t BreakpointPageWords = (1 << BreakpointPageShift) / 4 / 64;
+
+extern std::atomic<std::atomic<uint64_t> *>
+gBreakpointPages[BreakpointPageCount];
+
 bool
 hasBreakpoints();
 
 bool
 popBreakpoint(ppcaddr_t address);
 
+inline bool
+hasBreakpoint(ppcaddr_t address)
+{
+   auto page = gBreakpointPages[address >> BreakpointPageShift].load(std::memory_order_acquire);
+
+   if (!page) {
+      return false;
+   }
+
+   auto index = (address & ((1 << BreakpointPageShift) - 1)) >> 2;
+   return !!(page[index / 64].load(std::memory_order_relaxed) & (UINT64_C(1) << (index % 64)));
+}
+
 void
 timerEntryPoint();
 
+void
+initialiseTimeBase();
+
+// Re-anchors the time base to the host clock, returns when to call it next
+std::chrono::steady_clock::time_point
+updateTimeBase();
+
+uint64_t
+readTimeBase();
+
+uint64_t
+timePointToTb(std::chrono::steady_clock::time_point time);
+
+bool
+isJitTraceRingEnabled();
+
+// Appends a record for instr to core's trace ring, block terminators are
+//  written before they execute and everything else after.
+void
+writeTraceRecord(Core *core,
+                 uint32_t cia,
+                 espresso::Instruction instr,
+                 espresso::InstructionInfo *data,
+                 bool afterExecute);
+
 KernelCallEntry *
 getKernelCall(uint32_t id);
 
@@ -49,6 +106,36 @@ namespace this_core
 void
 updateRoundingMode();
 
+// Returns true if checkInterrupts has any work to do for this core
+inline bool
+hasPendingWork(Core *core)
+{
+   auto mask = core->interrupt_mask | NONMASKABLE_INTERRUPTS;
+   return (core->interrupt.load(std::memory_order_relaxed) & mask)
+       || hasBreakpoint(core->nia);
+}
+
+// Moves the virtual time base forward, raising the alarm interrupt when
+//  the countdown set by setNextAlarm runs out.
+inline void
+advanceVirtualTime(Core *core,
+                   uint64_t instructions)
+{
+   core->virtual_time += instructions;
+
+   if (!core->has_alarm) {
+      return;
+   }
+
+   if (core->virtual_countdown <= instructions) {
+      core->has_alarm = false;
+      core->virtual_countdown = 0;
+      core->interrupt.fetch_or(ALARM_INTERRUPT);
+   } else {
+      core->virtual_countdown -= instructions;
+   }
+}
+
 } // namespace this_core
 
 } // namespace cpu
@@ -10,12 +10,6 @@ namespace cpu
 InterruptHandler
 gInterruptHandler;
 
-std::mutex
-gInterruptMutex;
-
-std::condition_variable
-gInterruptCondition;
-
 std::mutex
 gTimerMutex;
 
@@ -34,9 +28,15 @@ setInterruptHandler(InterruptHandler handler)
 void
 interrupt(int core_idx, uint32_t flags)
 {
-   std::unique_lock<std::mutex> lock { gInterruptMutex };
-   gCore[core_idx].interrupt.fetch_or(flags);
-   gInterruptCondition.notify_all();
+   auto &core = gCore[core_idx];
+   core.interrupt.fetch_or(flags);
+
+   // The sleeping core re-checks interrupt while holding wakeMutex before
+   //  it waits, so taking the lock here means it can't miss the notify.
+   if (core.sleeping.load()) {
+      std::unique_lock<std::mutex> lock { core.wakeMutex };
+      core.wakeCondition.notify_one();
+   }
 }
 
 void
@@ -44,9 +44,12 @@ timerEntryPoint()
 {
    while (gRunning.load()) {
       std::unique_lock<std::mutex> lock{ gTimerMutex };
-      auto now = std::chrono::steady_clock::now();
-      auto next = std::chrono::steady_clock::time_point::max();
-      bool timedWait = false;
+      auto next = updateTimeBase();
+      auto timedWait = (next != std::chrono::steady_clock::time_point::max());
+
+      // Compare against the guest time base rather than the host clock so
+      //  an alarm is never delivered before the guest can see it is due.
+      auto now = tbToTimePoint(readTimeBase());
 
       for (auto i = 0; i < 3; ++i) {
          auto core = &gCore[i];
@@ -97,10 +100,15 @@ checkInterrupts()
 {
    auto core = state();
    auto mask = core->interrupt_mask | NONMASKABLE_INTERRUPTS;
-   auto flags = core->interrupt.fetch_and(~mask);
+   auto flags = 0u;
+
+   // Avoid the locked fetch_and unless something is actually pending
+   if (core->interrupt.load(std::memory_order_relaxed) & mask) {
+      flags = core->interrupt.fetch_and(~mask);
+   }
 
    // Check if we hit any breakpoints
-   if (popBreakpoint(core->nia)) {
+   if (hasBreakpoint(core->nia) && popBreakpoint(core->nia)) {
       flags |= DBGBREAK_INTERRUPT;
    }
 
@@ -113,7 +121,6 @@ void
 waitForInterrupt()
 {
    auto core = this_core::state();
-   std::unique_lock<std::mutex> lock { gInterruptMutex };
 
    while (true) {
       if (!(core->interrupt_mask & ~NONMASKABLE_INTERRUPTS)) {
@@ -124,12 +131,25 @@ waitForInterrupt()
       auto flags = core->interrupt.fetch_and(~mask);
 
       if (flags & mask) {
-         lock.unlock();
          gInterruptHandler(flags);
-         lock.lock();
-      } else {
-         gInterruptCondition.wait(lock);
+         continue;
+      }
+
+      // An idle core in virtual time skips straight to its next alarm
+      //  rather than waiting for the host clock to catch up.
+      if (gVirtualTime && core->has_alarm) {
+         this_core::advanceVirtualTime(core, core->virtual_countdown);
+         continue;
       }
+
+      std::unique_lock<std::mutex> lock { core->wakeMutex };
+      core->sleeping.store(true);
+
+      while (!(core->interrupt.load() & mask)) {
+         core->wakeCondition.wait(lock);
+      }
+
+      core->sleeping.store(false);
    }
 }
 
@@ -137,6 +157,27 @@ void
 setNextAlarm(std::chrono::steady_clock::time_point time)
 {
    auto core = this_core::state();
+
+   if (gVirtualTime) {
+      core->has_alarm = false;
+      core->virtual_countdown = 0;
+
+      if (time == std::chrono::steady_clock::time_point::max()) {
+         return;
+      }
+
+      auto alarm = timePointToTb(time) * VirtualTimeInstructionsPerTick;
+
+      if (alarm > core->virtual_time) {
+         core->virtual_countdown = alarm - core->virtual_time;
+         core->has_alarm = true;
+      } else {
+         core->interrupt.fetch_or(ALARM_INTERRUPT);
+      }
+
+      return;
+   }
+
    std::unique_lock<std::mutex> lock { gTimerMutex };
    core->next_alarm = time;
    gTimerCondition.notify_all();
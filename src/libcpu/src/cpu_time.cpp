@@ -0,0 +1,280 @@
+#include "cpu.h"
+#include "cpu_internal.h"
+
+#include <atomic>
+#include <chrono>
+#include <common/log.h>
+#include <common/platform.h>
+#include <cstdint>
+#include <thread>
+
+#ifdef PLATFORM_WINDOWS
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+namespace cpu
+{
+
+// How often the timer thread re-anchors the TSC time base to steady_clock
+static const auto TimeBaseUpdateInterval = std::chrono::seconds { 1 };
+
+// How long we spend measuring the TSC frequency at startup, any error is
+//  slewed out by updateTimeBase later.
+static const auto TimeBaseCalibrationTime = std::chrono::milliseconds { 10 };
+
+bool
+gVirtualTime = false;
+
+static std::chrono::steady_clock::time_point
+sStartupTime;
+
+static bool
+sUseTsc = false;
+
+static uint64_t
+sStartTsc;
+
+static std::chrono::steady_clock::time_point
+sLastUpdate;
+
+// The TSC conversion is a seqlock protected (tscBase, tbBase, mul) triple,
+//  mul is timer ticks per TSC tick in 32.32 fixed point.
+static std::atomic<uint32_t>
+sTscSequence { 0 };
+
+static std::atomic<uint64_t>
+sTscBase;
+
+static std::atomic<uint64_t>
+sTbBase;
+
+static std::atomic<uint64_t>
+sTscMul;
+
+static void
+cpuid(uint32_t leaf,
+      uint32_t regs[4])
+{
+#ifdef PLATFORM_WINDOWS
+   int cpuInfo[4];
+   __cpuid(cpuInfo, leaf);
+
+   for (auto i = 0; i < 4; ++i) {
+      regs[i] = static_cast<uint32_t>(cpuInfo[i]);
+   }
+#else
+   __asm__("cpuid"
+           : "=a" (regs[0]), "=b" (regs[1]), "=c" (regs[2]), "=d" (regs[3])
+           : "0" (leaf), "2" (0));
+#endif
+}
+
+static bool
+hostHasInvariantTsc()
+{
+   uint32_t regs[4];
+   cpuid(0x80000000, regs);
+
+   if (regs[0] < 0x80000007) {
+      return false;
+   }
+
+   cpuid(0x80000007, regs);
+   return !!(regs[3] & (1 << 8));
+}
+
+static inline uint64_t
+mulShift32(uint64_t a,
+           uint64_t b)
+{
+#ifdef PLATFORM_WINDOWS
+   uint64_t hi;
+   auto lo = _umul128(a, b, &hi);
+   return (hi << 32) | (lo >> 32);
+#else
+   return static_cast<uint64_t>((static_cast<unsigned __int128>(a) * b) >> 32);
+#endif
+}
+
+static uint64_t
+tscToTimeBase(uint64_t tsc)
+{
+   uint32_t sequence;
+   uint64_t tscBase, tbBase, mul;
+
+   do {
+      sequence = sTscSequence.load(std::memory_order_acquire);
+      tscBase = sTscBase.load(std::memory_order_relaxed);
+      tbBase = sTbBase.load(std::memory_order_relaxed);
+      mul = sTscMul.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+   } while ((sequence & 1) || sequence != sTscSequence.load(std::memory_order_relaxed));
+
+   // Invariant TSC is synchronised across host cores, but don't let a
+   //  read which raced with an update step backwards.
+   if (tsc < tscBase) {
+      return tbBase;
+   }
+
+   return tbBase + mulShift32(tsc - tscBase, mul);
+}
+
+static void
+setTscParams(uint64_t tscBase,
+             uint64_t tbBase,
+             uint64_t mul)
+{
+   auto sequence = sTscSequence.load(std::memory_order_relaxed);
+   sTscSequence.store(sequence + 1, std::memory_order_relaxed);
+   std::atomic_thread_fence(std::memory_order_release);
+
+   sTscBase.store(tscBase, std::memory_order_relaxed);
+   sTbBase.store(tbBase, std::memory_order_relaxed);
+   sTscMul.store(mul, std::memory_order_relaxed);
+
+   sTscSequence.store(sequence + 2, std::memory_order_release);
+}
+
+static uint64_t
+rateToMul(double ticksPerTsc)
+{
+   return static_cast<uint64_t>(ticksPerTsc * 4294967296.0);
+}
+
+void
+initialiseTimeBase()
+{
+   sUseTsc = hostHasInvariantTsc();
+
+   if (sUseTsc) {
+      auto tsc0 = __rdtsc();
+      auto time0 = std::chrono::steady_clock::now();
+      std::this_thread::sleep_for(TimeBaseCalibrationTime);
+      auto tsc1 = __rdtsc();
+      auto time1 = std::chrono::steady_clock::now();
+
+      auto seconds = std::chrono::duration<double> { time1 - time0 }.count();
+      auto tscFrequency = static_cast<double>(tsc1 - tsc0) / seconds;
+
+      if (tsc1 <= tsc0 || tscFrequency < timerClockSpeed) {
+         gLog->warn("Ignoring invariant TSC with bogus frequency {}", tscFrequency);
+         sUseTsc = false;
+      } else {
+         gLog->info("Using invariant TSC time base, {:.0f} Hz", tscFrequency);
+         sStartTsc = tsc1;
+         setTscParams(tsc1, 0, rateToMul(timerClockSpeed / tscFrequency));
+      }
+   }
+
+   sStartupTime = std::chrono::steady_clock::now();
+   sLastUpdate = sStartupTime;
+}
+
+std::chrono::steady_clock::time_point
+updateTimeBase()
+{
+   if (!sUseTsc || gVirtualTime) {
+      return std::chrono::steady_clock::time_point::max();
+   }
+
+   auto now = std::chrono::steady_clock::now();
+
+   if (now - sLastUpdate < TimeBaseUpdateInterval) {
+      return sLastUpdate + TimeBaseUpdateInterval;
+   }
+
+   auto tsc = __rdtsc();
+   auto current = tscToTimeBase(tsc);
+   auto target = std::chrono::duration_cast<TimerDuration>(now - sStartupTime).count();
+
+   // Use the long run rate since startup, then slew away whatever error
+   //  has built up over the next interval so we never step the clock.
+   auto rate = static_cast<double>(target) / static_cast<double>(tsc - sStartTsc);
+   auto intervalTicks = static_cast<double>(std::chrono::duration_cast<TimerDuration>(TimeBaseUpdateInterval).count());
+   auto error = static_cast<double>(target) - static_cast<double>(current);
+   auto slew = 1.0 + error / intervalTicks;
+
+   if (slew < 0.5) {
+      slew = 0.5;
+   } else if (slew > 1.5) {
+      slew = 1.5;
+   }
+
+   setTscParams(tsc, current, rateToMul(rate * slew));
+   sLastUpdate = now;
+   return sLastUpdate + TimeBaseUpdateInterval;
+}
+
+uint64_t
+readTimeBase()
+{
+   if (sUseTsc) {
+      return tscToTimeBase(__rdtsc());
+   }
+
+   auto now = std::chrono::steady_clock::now();
+   return std::chrono::duration_cast<TimerDuration>(now - sStartupTime).count();
+}
+
+std::chrono::steady_clock::time_point
+tbToTimePoint(uint64_t ticks)
+{
+   auto cpuTicks = TimerDuration(ticks);
+   auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(cpuTicks);
+   return sStartupTime + nanos;
+}
+
+uint64_t
+timePointToTb(std::chrono::steady_clock::time_point time)
+{
+   if (time <= sStartupTime) {
+      return 0;
+   }
+
+   auto ticks = std::chrono::duration_cast<TimerDuration>(time - sStartupTime).count();
+
+   // Round up so the time base never reads as due before time is reached
+   if (tbToTimePoint(ticks) < time) {
+      ticks++;
+   }
+
+   return ticks;
+}
+
+uint64_t
+Core::tb()
+{
+   if (gVirtualTime) {
+      // Each core counts only its own instructions, see syncTimeBase for
+      //  how threads moving between cores are kept monotonic.
+      return virtual_time / VirtualTimeInstructionsPerTick;
+   }
+
+   return readTimeBase();
+}
+
+void
+setVirtualTime(bool enabled)
+{
+   gVirtualTime = enabled;
+}
+
+namespace this_core
+{
+
+void
+syncTimeBase(uint64_t tb)
+{
+   auto core = state();
+   auto target = tb * VirtualTimeInstructionsPerTick;
+
+   if (gVirtualTime && core->virtual_time < target) {
+      advanceVirtualTime(core, target - core->virtual_time);
+   }
+}
+
+} // namespace this_core
+
+} // namespace cpu
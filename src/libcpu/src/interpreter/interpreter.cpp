@@ -6,7 +6,13 @@
 #include "interpreter_insreg.h"
 #include "mem.h"
 #include "trace.h"
+#include <algorithm>
+#include <atomic>
 #include <cfenv>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 namespace cpu
 {
@@ -14,9 +20,53 @@ namespace cpu
 namespace interpreter
 {
 
+// Decoded blocks stop after this many instructions even without a branch
+static const uint32_t MaxBlockInstructions = 64;
+
+// Decoded blocks never cross a page, so they are indexed by the page they are in
+static const uint32_t DecodePageShift = 12;
+
+struct DecodedInstruction
+{
+   instrfptr_t fptr;
+   espresso::Instruction instr;
+   espresso::InstructionInfo *data;
+};
+
+struct DecodedBlock
+{
+   uint32_t start;
+
+   //! 64 bit so a block at the top of memory does not wrap to 0
+   uint64_t end;
+   std::vector<DecodedInstruction> instructions;
+};
+
+// Each core has its own cache so lookups never take a lock, other threads
+//  queue their invalidations which the owning core applies the next time
+//  it looks up a block.  Blocks are shared_ptr because an interrupt may
+//  switch to another fiber which invalidates the block we were running.
+struct DecodeCache
+{
+   std::atomic<bool> invalidated { false };
+   std::mutex mutex;
+   bool pendingClear = false;
+
+   //! Invalidated [start, end) ranges, adjacent ranges are merged
+   std::vector<std::pair<uint64_t, uint64_t>> pending;
+
+   std::unordered_map<uint32_t, std::shared_ptr<DecodedBlock>> blocks;
+
+   //! Start address of the blocks in each page
+   std::unordered_map<uint32_t, std::vector<uint32_t>> pageBlocks;
+};
+
 static std::vector<instrfptr_t>
 sInstructionMap;
 
+static DecodeCache
+sDecodeCache[3];
+
 void
 initialise()
 {
@@ -59,7 +109,9 @@ hasInstruction(espresso::InstructionID id)
 Core *
 step_one(Core *core)
 {
-   this_core::checkInterrupts();
+   if (this_core::hasPendingWork(core)) {
+      this_core::checkInterrupts();
+   }
 
    // The interrupt call above may have switched what core we are on,
    //  we need to pick up the new core, who knows why we even pass
@@ -91,6 +143,13 @@ step_one(Core *core)
    }
    decaf_check(fptr);
 
+   // Terminators are traced before they execute to match the JIT
+   auto terminator = isBlockTerminator(data->id);
+
+   if (core->traceRing && terminator) {
+      writeTraceRecord(core, cia, instr, data, false);
+   }
+
    fptr(core, instr);
 
    if (data->id == InstructionID::kc) {
@@ -99,12 +158,270 @@ step_one(Core *core)
       core = this_core::state();
    }
 
+   if (gVirtualTime) {
+      this_core::advanceVirtualTime(core, 1);
+   }
+
+   if (core->traceRing && !terminator) {
+      writeTraceRecord(core, cia, instr, data, true);
+   }
+
+   if (data->usesFpr) {
+      core->fpuUsed = true;
+   }
+
    decaf_check(core->cia == cia);
    traceInstructionEnd(trace, instr, data, core);
 
    return core;
 }
 
+bool
+isBlockTerminator(espresso::InstructionID id)
+{
+   switch (id) {
+   case InstructionID::b:
+   case InstructionID::bc:
+   case InstructionID::bcctr:
+   case InstructionID::bclr:
+   case InstructionID::kc:
+   case InstructionID::rfi:
+   case InstructionID::sc:
+   case InstructionID::tw:
+   case InstructionID::twi:
+      return true;
+   default:
+      return false;
+   }
+}
+
+static std::shared_ptr<DecodedBlock>
+decodeBlock(uint32_t address)
+{
+   auto block = std::make_shared<DecodedBlock>();
+   block->start = address;
+
+   // Never decode past the end of the page in case the next one is unmapped
+   auto pageSize = uint64_t { 1 } << DecodePageShift;
+   auto pageEnd = (static_cast<uint64_t>(address) | (pageSize - 1)) + 1;
+
+   for (auto cia = uint64_t { address }; cia < pageEnd; cia += 4) {
+      auto instr = mem::read<espresso::Instruction>(static_cast<uint32_t>(cia));
+      auto data = espresso::decodeInstruction(instr);
+
+      // Leave anything we can't execute for step_one to report
+      if (!data || !sInstructionMap[static_cast<size_t>(data->id)]) {
+         break;
+      }
+
+      block->instructions.push_back({ sInstructionMap[static_cast<size_t>(data->id)], instr, data });
+
+      if (isBlockTerminator(data->id)
+       || block->instructions.size() == MaxBlockInstructions) {
+         break;
+      }
+   }
+
+   block->end = uint64_t { address } + block->instructions.size() * 4;
+   return block;
+}
+
+static void
+applyInvalidations(DecodeCache &cache)
+{
+   std::unique_lock<std::mutex> lock { cache.mutex };
+   cache.invalidated.store(false, std::memory_order_relaxed);
+
+   if (cache.pendingClear) {
+      cache.blocks.clear();
+      cache.pageBlocks.clear();
+      cache.pending.clear();
+      cache.pendingClear = false;
+      return;
+   }
+
+   for (auto &range : cache.pending) {
+      auto start = range.first;
+      auto end = range.second;
+      auto firstPage = static_cast<uint32_t>(start >> DecodePageShift);
+      auto lastPage = static_cast<uint32_t>((end - 1) >> DecodePageShift);
+
+      // Only visit the pages which have blocks in them
+      auto pages = std::vector<uint32_t> { };
+
+      if (uint64_t { lastPage } - firstPage + 1 > cache.pageBlocks.size()) {
+         for (auto &itr : cache.pageBlocks) {
+            if (itr.first >= firstPage && itr.first <= lastPage) {
+               pages.push_back(itr.first);
+            }
+         }
+      } else {
+         for (auto page = uint64_t { firstPage }; page <= lastPage; ++page) {
+            if (cache.pageBlocks.count(static_cast<uint32_t>(page))) {
+               pages.push_back(static_cast<uint32_t>(page));
+            }
+         }
+      }
+
+      for (auto page : pages) {
+         auto &starts = cache.pageBlocks[page];
+
+         for (auto itr = starts.begin(); itr != starts.end(); ) {
+            auto block = cache.blocks.find(*itr);
+
+            if (block->second->start < end && block->second->end > start) {
+               cache.blocks.erase(block);
+               itr = starts.erase(itr);
+            } else {
+               ++itr;
+            }
+         }
+
+         if (starts.empty()) {
+            cache.pageBlocks.erase(page);
+         }
+      }
+   }
+
+   cache.pending.clear();
+}
+
+static std::shared_ptr<DecodedBlock>
+getBlock(DecodeCache &cache,
+         uint32_t address)
+{
+   if (cache.invalidated.load(std::memory_order_acquire)) {
+      applyInvalidations(cache);
+   }
+
+   auto itr = cache.blocks.find(address);
+
+   if (itr != cache.blocks.end()) {
+      return itr->second;
+   }
+
+   auto block = decodeBlock(address);
+
+   if (!block->instructions.empty()) {
+      cache.blocks.emplace(address, block);
+      cache.pageBlocks[address >> DecodePageShift].push_back(address);
+   }
+
+   return block;
+}
+
+Core *
+step_block(Core *core)
+{
+   decaf_check(core->id < 3);
+   auto &cache = sDecodeCache[core->id];
+   auto block = getBlock(cache, core->nia);
+
+   if (block->instructions.empty()) {
+      return step_one(core);
+   }
+
+   auto cia = block->start;
+
+   for (auto &entry : block->instructions) {
+      // Only poll when an interrupt is pending or there is a breakpoint here
+      if (this_core::hasPendingWork(core)) {
+         this_core::checkInterrupts();
+
+         // Stop if an interrupt moved us somewhere else
+         if (this_core::state() != core || core->nia != cia) {
+            return this_core::state();
+         }
+      }
+
+      if (cache.invalidated.load(std::memory_order_relaxed)) {
+         return core;
+      }
+
+      core->nia = cia + 4;
+      core->cia = cia;
+
+      auto trace = traceInstructionStart(entry.instr, entry.data, core);
+      auto terminator = isBlockTerminator(entry.data->id);
+
+      if (core->traceRing && terminator) {
+         writeTraceRecord(core, cia, entry.instr, entry.data, false);
+      }
+
+      entry.fptr(core, entry.instr);
+
+      if (entry.data->id == InstructionID::kc) {
+         // If this is a KC, there is the potential that we are running on a
+         //  different core now.  Lets make sure that we are using the right one.
+         core = this_core::state();
+      }
+
+      if (gVirtualTime) {
+         this_core::advanceVirtualTime(core, 1);
+      }
+
+      if (core->traceRing && !terminator) {
+         writeTraceRecord(core, cia, entry.instr, entry.data, true);
+      }
+
+      if (entry.data->usesFpr) {
+         core->fpuUsed = true;
+      }
+
+      decaf_check(core->cia == cia);
+      traceInstructionEnd(trace, entry.instr, entry.data, core);
+
+      // Stop after anything which did not fall through to the next
+      cia += 4;
+
+      if (core->nia != cia) {
+         break;
+      }
+   }
+
+   return core;
+}
+
+void
+invalidateRange(uint32_t address,
+                uint32_t size)
+{
+   if (!size) {
+      return;
+   }
+
+   auto start = uint64_t { address };
+   auto end = start + size;
+
+   for (auto &cache : sDecodeCache) {
+      std::unique_lock<std::mutex> lock { cache.mutex };
+
+      // Code is usually written in order, so extend the last range if we can
+      if (!cache.pending.empty()
+       && cache.pending.back().first <= end
+       && cache.pending.back().second >= start) {
+         auto &last = cache.pending.back();
+         last.first = std::min(last.first, start);
+         last.second = std::max(last.second, end);
+      } else {
+         cache.pending.emplace_back(start, end);
+      }
+
+      cache.invalidated.store(true, std::memory_order_release);
+   }
+}
+
+void
+clearCache()
+{
+   // Not a range, as a 32 bit size can not cover the whole address space
+   for (auto &cache : sDecodeCache) {
+      std::unique_lock<std::mutex> lock { cache.mutex };
+      cache.pendingClear = true;
+      cache.invalidated.store(true, std::memory_order_release);
+   }
+}
+
 void
 resume()
 {
@@ -114,7 +431,7 @@ resume()
 
    auto core = cpu::this_core::state();
    while (core->nia != cpu::CALLBACK_ADDR) {
-      core = step_one(core);
+      core = step_block(core);
    }
 }
 
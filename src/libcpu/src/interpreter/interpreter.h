@@ -1,5 +1,6 @@
 #pragma once
 #include "cpu.h"
+#include "espresso/espresso_instructionid.h"
 
 namespace cpu
 {
@@ -13,6 +14,23 @@ initialise();
 void
 resume();
 
+Core *
+step_one(Core *core);
+
+Core *
+step_block(Core *core);
+
+void
+invalidateRange(uint32_t address,
+                uint32_t size);
+
+void
+clearCache();
+
+// Returns true for instructions which may not fall through to the next
+bool
+isBlockTerminator(espresso::InstructionID id);
+
 } // namespace interpreter
 
 } // namespace cpu
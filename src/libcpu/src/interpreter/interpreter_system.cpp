@@ -27,10 +27,21 @@ INS(eciwx, (rd), (ra, rb), (), (opcd == 31, xo1 == 310), "")
 INS(ecowx, (rd), (ra, rb), (), (opcd == 31, xo1 == 438), "")
 */
 
-// Cache Management
+// Instruction Cache Block Invalidate
 static void
 icbi(cpu::Core *state, Instruction instr)
 {
+   uint32_t addr;
+
+   if (instr.rA == 0) {
+      addr = 0;
+   } else {
+      addr = state->gpr[instr.rA];
+   }
+
+   addr += state->gpr[instr.rB];
+   addr = align_down(addr, 32);
+   cpu::invalidateInstructionCache(addr, 32);
 }
 
 // Data Cache Block Flush
@@ -1,22 +1,35 @@
 #include "cpu.h"
 #include "cpu_internal.h"
 #include "espresso/espresso_instructionset.h"
+#include "interpreter/interpreter.h"
 #include "jit.h"
+#include "jit_cache.h"
 #include "jit_internal.h"
 #include "jit_insreg.h"
+#include "jit_profile.h"
 #include "jit_verify.h"
 #include "jit_vmemruntime.h"
 #include "mem.h"
+#include "trace.h"
+#include "trace_ring.h"
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <common/align.h>
 #include <common/bitutils.h>
 #include <common/decaf_assert.h>
 #include <common/fastregionmap.h>
 #include <common/log.h>
 #include <cfenv>
+#include <common/platform_thread.h>
+#include <condition_variable>
+#include <deque>
 #include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace cpu
@@ -25,10 +38,20 @@ namespace cpu
 namespace jit
 {
 
-static const bool JIT_DEBUG = true;
+// Store nia before every instruction and pad instructions with a NOP,
+//  this makes generated code easier to follow in a debugger.  Faults are
+//  mapped back to guest addresses with the block address maps instead.
+static const bool JIT_DEBUG = false;
 static const int JIT_MAX_INST = 3000;
 static const bool JIT_REGCACHE = true;
 
+// Granularity at which we track which guest code a block was built from
+static const uint32_t JIT_PAGE_SHIFT = 12;
+
+// Number of times a block must be entered in the interpreter before
+//  it is queued for compilation when running in tiered mode.
+static const uint32_t JIT_TIER_THRESHOLD = 64;
+
 // Insert NOPs at the beginning of a generated block of code.
 //  The Visual Studio disassembler can get confused without these.
 static const bool JIT_INITIAL_NOPS =
@@ -50,6 +73,94 @@ sJitBlocks;
 static std::array<uint8_t, 32>
 sBaseRelocCode;
 
+struct JitBlockInfo
+{
+   uint32_t start;
+   uint32_t end;
+   uint8_t *codeStart;
+   uint8_t *codeEnd;
+
+   // Every guest address which was registered in sJitBlocks for this block
+   std::vector<std::pair<uint32_t, JitCode>> entries;
+
+   // Pairs of host code offset and guest address of each instruction
+   std::vector<std::pair<uint32_t, uint32_t>> addressMap;
+
+   // Number of times the block was entered, when profiling
+   uint64_t *entryCount;
+};
+
+// Protects all the block tracking and linking state below
+static std::mutex
+sBlockMutex;
+
+// Bumped whenever a block is invalidated, so host side caches of block
+//  entry points (see resumeSub) know they must look them up again.
+static std::atomic<uint32_t>
+sBlockGeneration { 1 };
+
+// Blocks which are currently registered, keyed by their host code address
+static std::map<uint8_t *, JitBlockInfo>
+sBlockInfo;
+
+// Blocks which were built from each guest page
+static std::unordered_map<uint32_t, std::vector<uint8_t *>>
+sPageBlocks;
+
+// Bumped by every invalidateRange, a block compiler snapshots this before
+//  reading guest code so it can tell if the code changed underneath it.
+static std::atomic<uint64_t>
+sInvalidationSerial { 0 };
+
+// The sInvalidationSerial of the last invalidateRange to touch each page
+static std::unordered_map<uint32_t, uint64_t>
+sPageInvalidations;
+
+// Relocation slots which have been linked, and the code they jump to
+static std::map<JitCode *, JitCode>
+sLinkTargets;
+
+// Relocation slots which jump to each piece of code
+static std::unordered_map<JitCode, std::vector<JitCode *>>
+sLinkSources;
+
+// Per-core count of how often each cold block has been entered
+static thread_local std::unordered_map<uint32_t, uint32_t>
+tBlockCounters;
+
+// Host code for guest functions called from the host, see resumeSub
+struct SubCallEntry
+{
+   uint32_t address = 0;
+   uint32_t generation = 0;
+   JitCode code = nullptr;
+};
+
+static const uint32_t
+SubCallCacheSize = 256;
+
+// Direct mapped by guest address, one per core so it needs no locking
+static thread_local std::array<SubCallEntry, SubCallCacheSize>
+tSubCallCache;
+
+static std::thread
+sCompilerThread;
+
+static std::mutex
+sCompilerMutex;
+
+static std::condition_variable
+sCompilerCondition;
+
+static std::deque<uint32_t>
+sCompilerQueue;
+
+static std::unordered_set<uint32_t>
+sCompilerQueued;
+
+static bool
+sCompilerRunning = false;
+
 static void *
 sPreInstr;
 
@@ -62,6 +173,9 @@ gCallFn;
 JitFinale
 gFinaleFn;
 
+JitImports
+gJitImports;
+
 void
 registerUnwindTable(VMemRuntime *runtime, intptr_t jitCallAddr);
 
@@ -71,6 +185,9 @@ unregisterUnwindTable();
 JitCode
 jit_continue(uint32_t addr, JitCode *jumpSource);
 
+static void
+startCompiler();
+
 static void
 initStubs()
 {
@@ -85,6 +202,7 @@ initStubs()
    auto introLabel = a.newLabel();
    auto extroLabel = a.newLabel();
    auto exitLabel = a.newLabel();
+   auto exitNoNiaLabel = a.newLabel();
    auto verifyPreLabel = a.newLabel();
    auto verifyPostLabel = a.newLabel();
 
@@ -118,6 +236,7 @@ initStubs()
    a.sub(asmjit::x86::rsp, stackSpace);
    a.mov(a.stateReg, a.sysArgReg[0]);
    a.mov(a.membaseReg, static_cast<uint64_t>(mem::base()));
+   a.reloadPinned();
    a.jmp(a.sysArgReg[1]);
 
    // This is the piece of code executed when we are finished
@@ -128,14 +247,21 @@ initStubs()
    a.je(exitLabel);
 
    // If we should continue generating, lets call the
-   //  generator instead to find our new address!
+   //  generator instead to find our new address!  We store
+   //  nia first so we can still exit if there is no code for
+   //  it yet, which happens for cold code in tiered mode.
+   a.mov(a.niaMem, a.finaleNiaArgReg);
    a.mov(asmjit::x86::rax, asmjit::Ptr(jit_continue));
    a.call(asmjit::x86::rax);
+   a.test(asmjit::x86::rax, asmjit::x86::rax);
+   a.jz(exitNoNiaLabel);
    a.jmp(asmjit::x86::rax);
 
    // This is how we exit back to the caller
    a.bind(exitLabel);
    a.mov(a.niaMem, a.finaleNiaArgReg);
+   a.bind(exitNoNiaLabel);
+   a.spillPinned();
    a.mov(asmjit::x86::rax, a.stateReg);
    a.add(asmjit::x86::rsp, stackSpace);
    a.pop(asmjit::x86::r15);
@@ -229,6 +355,7 @@ initStubs()
    }
 
    auto basePtr = a.make();
+   writePerfMapEntry(basePtr, a.getCodeSize(), "decaf_jit_stubs");
    gCallFn = asmjit_cast<JitCall>(basePtr, a.getLabelOffset(introLabel));
    gFinaleFn = asmjit_cast<JitCall>(basePtr, a.getLabelOffset(extroLabel));
    if (gJitMode == jit_mode::verify) {
@@ -252,12 +379,36 @@ initStubs()
    decaf_check(ra.getOffset() == 32);
 }
 
+static void
+initImports()
+{
+   auto setConstant = [](JitConstantId id, uint64_t lo, uint64_t hi) {
+      gJitImports.constants[static_cast<size_t>(id)] = JitConstant { lo, hi };
+   };
+
+   setConstant(JitConstantId::FloatSignMask, UINT64_C(0x8000000000000000), UINT64_C(0x8000000000000000));
+   setConstant(JitConstantId::FloatAbsMask, UINT64_C(0x7FFFFFFFFFFFFFFF), UINT64_C(0x7FFFFFFFFFFFFFFF));
+   setConstant(JitConstantId::Ps0Round24Mask, UINT64_C(0xFFFFFFFFF8000000), UINT64_C(0xFFFFFFFFFFFFFFFF));
+   setConstant(JitConstantId::Ps0Round24Bit, UINT64_C(0x8000000), UINT64_C(0));
+   setConstant(JitConstantId::Round24Mask, UINT64_C(0xFFFFFFFFF8000000), UINT64_C(0xFFFFFFFFF8000000));
+   setConstant(JitConstantId::Round24Bit, UINT64_C(0x8000000), UINT64_C(0x8000000));
+
+   initialiseFallbackImports(gJitImports);
+
+   for (auto &core : gCore) {
+      core.jitImports = &gJitImports;
+   }
+}
+
 void
 initialiseRuntime()
 {
    sRuntime = new VMemRuntime(0x20000, 0x40000000);
    initStubs();
    registerUnwindTable(sRuntime, reinterpret_cast<intptr_t>(gCallFn));
+
+   // The finale stub is regenerated along with the runtime
+   gJitImports.finaleFn = gFinaleFn;
 }
 
 void
@@ -276,6 +427,7 @@ initialise()
    initialiseRuntime();
 
    sInstructionMap.resize(static_cast<size_t>(espresso::InstructionID::InstructionCount), nullptr);
+   initImports();
 
    // Register instruction handlers
    registerBranchInstructions();
@@ -285,6 +437,12 @@ initialise()
    registerLoadStoreInstructions();
    registerPairedInstructions();
    registerSystemInstructions();
+
+   // Only once every handler is registered, otherwise a compile request
+   //  which arrives during init would generate int3 for everything.
+   if (gJitMode == jit_mode::tiered) {
+      startCompiler();
+   }
 }
 
 jitinstrfptr_t
@@ -317,10 +475,17 @@ clearCache()
    // Note: This must not be called unless there is guarenteed to be
    //  nobody currently executing code!
 
+   std::unique_lock<std::mutex> lock { sBlockMutex };
+
    freeRuntime();
    initialiseRuntime();
 
+   sBlockGeneration.fetch_add(1, std::memory_order_release);
    sJitBlocks.clear();
+   sBlockInfo.clear();
+   sPageBlocks.clear();
+   sLinkTargets.clear();
+   sLinkSources.clear();
 }
 
 using JumpTargetList = std::vector<uint32_t>;
@@ -330,28 +495,147 @@ jit_b_direct(PPCEmuAssembler& a, ppcaddr_t addr)
 {
    a.saveAll();
 
-   auto target = sJitBlocks.find(addr);
-   if (target) {
-      // We already know where this function is, let's just jump
-      //  directly to it rather than wasting time going through
-      //  the JIT dispatcher!
-      a.jmp(asmjit::Ptr(target));
-   } else {
-      // We have not JIT'd this section yet.  Let's allocate some
-      //  space for an aligned MOV instruction, then mark it as a
-      //  relocation so it can be filled by the 'linker' below.
-      auto relocLbl = a.newLabel();
-      a.bind(relocLbl);
+   auto label = a.jumpLabels.find(addr);
+   if (label != a.jumpLabels.end() && addr > a.genCia) {
+      // This branch goes forward inside the block we are generating, the
+      //  register cache is always empty at a jump target so we can
+      //  simply jump straight to it.
+      a.jmp(label->second);
+      return;
+   }
 
-      // Save 32 bytes of memory so we have room to do set up the
-      //  call during relocation once we know where its going to
-      //  reside in the host jit memory section.
-      for (auto i = 0; i < 32; ++i) {
-         a.int3();
-      }
-      a.jmp(asmjit::x86::rax);
+   // Always go through a relocation, even if we already know where the
+   //  target is, so the jump can be unlinked again if the target block
+   //  is invalidated.  This includes backward branches inside the block,
+   //  otherwise a core looping in an invalidated block would never leave
+   //  it.  Let's allocate some space for an aligned MOV
+   //  instruction, then mark it as a relocation so it can be filled by
+   //  the 'linker' below.
+   auto relocLbl = a.newLabel();
+   a.bind(relocLbl);
+
+   // Save 32 bytes of memory so we have room to do set up the
+   //  call during relocation once we know where its going to
+   //  reside in the host jit memory section.
+   for (auto i = 0; i < 32; ++i) {
+      a.int3();
+   }
+   a.jmp(asmjit::x86::rax);
+
+   a.relocLabels.emplace_back(addr, relocLbl);
+}
+
+// Write a relocation which jumps to the Finale, it can later be
+//  overwritten atomically by the generator to link directly to the
+//  target block.  Returns the slot holding the jump target.
+static JitCode *
+writeRelocation(uint8_t *mem, uint32_t addr)
+{
+   // We use a trick here to save some bytes.  We write the addr
+   //  part of the info while relocating in spite of being able
+   //  to do it during initial generation, this allows us to move
+   //  it to before or after the aligned MOV which saves us some
+   //  bytes that would otherwise be wasted on NOP's.
+
+   auto targetAddr = asmjit::Ptr(gFinaleFn);
+
+   auto aligned_offset = align_up(mem + 15 + 2, 8) - mem;
+   auto aligned_mov_offset = aligned_offset - 2;
+   auto aligned_base_offset = reinterpret_cast<intptr_t>(mem + aligned_offset);
+
+   // Copy the pregenerated relocation code bytes
+   std::copy(sBaseRelocCode.begin(), sBaseRelocCode.end(), mem);
+
+   // Write addr of `MOV finaleNiaArgReg, addr`
+   *reinterpret_cast<uint32_t*>(&mem[1]) = addr;
+
+   // Write relmem of `MOV finaleJmpSrcArgReg, relmem`
+   *reinterpret_cast<intptr_t*>(&mem[7]) = aligned_base_offset;
+
+   // Write `MOV RAX, target`
+   mem[aligned_mov_offset + 0] = 0x48;
+   mem[aligned_mov_offset + 1] = 0xB8;
+   auto atomicAddr = &mem[aligned_mov_offset + 2];
+   decaf_check(align_up(atomicAddr, 8) == atomicAddr);
+   *reinterpret_cast<uint64_t*>(atomicAddr) = targetAddr;
+
+   return reinterpret_cast<JitCode *>(atomicAddr);
+}
+
+// Appends a record to the core's trace ring, this mirrors writeTraceRecord.
+static void
+genTraceRecord(PPCEmuAssembler &a,
+               espresso::Instruction instr,
+               espresso::InstructionInfo *data,
+               bool afterExecute)
+{
+   TraceFieldType fields[TraceRecordMaxFields];
+   auto truncated = false;
+   auto numFields = afterExecute ? getTraceWriteFields(instr, data, fields, TraceRecordMaxFields, &truncated) : 0;
+
+   auto record = a.allocGpTmp().r64();
+   auto tmp = a.allocGpTmp().r64();
+
+   // record = traceRing + (traceIndex++ & traceMask) * sizeof(TraceRecord)
+   a.mov(record, a.traceIndexMem);
+   a.lea(tmp, asmjit::X86Mem(record, 1, 8));
+   a.mov(a.traceIndexMem, tmp);
+   a.and_(record, a.traceMaskMem);
+   a.shl(record, 5);
+   a.add(record, a.traceRingMem);
+
+   auto fieldBytes = 0u;
+
+   for (auto i = 0u; i < TraceRecordMaxFields; ++i) {
+      auto field = i < numFields ? fields[i] : StateField::Invalid;
+      fieldBytes |= static_cast<uint8_t>(field) << (i * 8);
+   }
+
+   // flags follows the fields, so they are written together
+   static_assert(offsetof(TraceRecord, flags) == offsetof(TraceRecord, fields) + TraceRecordMaxFields,
+                 "TraceRecord flags must follow fields");
 
-      a.relocLabels.emplace_back(addr, relocLbl);
+   if (truncated) {
+      fieldBytes |= TraceRecordTruncated << (TraceRecordMaxFields * 8);
+   }
+
+   a.mov(asmjit::X86Mem(record, offsetof2(TraceRecord, cia), 4), a.genCia);
+   a.mov(asmjit::X86Mem(record, offsetof2(TraceRecord, instr), 4), instr.value);
+   a.mov(asmjit::X86Mem(record, offsetof2(TraceRecord, fields), 4), fieldBytes);
+
+   for (auto i = 0u; i < TraceRecordMaxFields; ++i) {
+      auto offset = static_cast<int32_t>(offsetof2(TraceRecord, values) + i * sizeof(uint64_t));
+      auto valueMem = asmjit::X86Mem(record, offset, 8);
+      auto valueLo = asmjit::X86Mem(record, offset, 4);
+      auto valueHi = asmjit::X86Mem(record, offset + 4, 4);
+      auto field = i < numFields ? fields[i] : StateField::Invalid;
+
+      if (field >= StateField::GPR0 && field <= StateField::GPR31) {
+         a.mov(valueLo, a.loadRegisterRead(a.gpr[field - StateField::GPR]));
+         a.mov(valueHi, 0);
+      } else if (field >= StateField::FPR0 && field <= StateField::FPR31) {
+         a.movq(valueMem, a.loadRegisterRead(a.fprps[field - StateField::FPR]));
+      } else if (field >= StateField::GQR0 && field <= StateField::GQR7) {
+         a.mov(valueLo, a.loadRegisterRead(a.gqr[field - StateField::GQR]));
+         a.mov(valueHi, 0);
+      } else if (field == StateField::CR) {
+         a.mov(valueLo, a.loadRegisterRead(a.cr));
+         a.mov(valueHi, 0);
+      } else if (field == StateField::XER) {
+         a.mov(valueLo, a.loadRegisterRead(a.xer));
+         a.mov(valueHi, 0);
+      } else if (field == StateField::FPSCR) {
+         a.mov(valueLo, a.loadRegisterRead(a.fpscr));
+         a.mov(valueHi, 0);
+      } else if (field == StateField::LR) {
+         a.mov(tmp.r32(), a.lrMem);
+         a.mov(valueMem, tmp);
+      } else if (field == StateField::CTR) {
+         a.mov(tmp.r32(), a.ctrMem);
+         a.mov(valueMem, tmp);
+      } else {
+         a.mov(valueMem, 0);
+      }
    }
 }
 
@@ -367,29 +651,63 @@ gen(JitBlock &block)
    };
    std::map<uint32_t, TargetLblPair> targetLbls;
    for (uint32_t i = 0; i < block.targets.size(); ++i) {
-      targetLbls.emplace(block.targets[i].first, TargetLblPair{ i, a.newLabel() });
+      auto label = a.newLabel();
+      targetLbls.emplace(block.targets[i].first, TargetLblPair{ i, label });
+
+      // Branch tracing needs every taken branch to go through
+      //  jit_continue, so only link internal branches without it.
+      if (!gBranchTraceHandler) {
+         a.jumpLabels.emplace(block.targets[i].first, label);
+      }
    }
 
    auto codeStart = a.newLabel();
    uint32_t lclCia;
    a.bind(codeStart);
 
+   // Blocks are only cached when their code is fully relocatable
+   auto cacheable = isCacheEnabled()
+                 && gJitMode != jit_mode::verify
+                 && !gBranchTraceHandler;
+   auto traceRing = isJitTraceRingEnabled();
+
    if (JIT_DEBUG && JIT_INITIAL_NOPS) {
       for (auto i = 0; i < 12; ++i) {
          a.nop();
       }
    }
 
+   // Count entries into the block, the counter lives in JIT memory
+   //  which means these blocks can not be cached.
+   if (isProfilingEnabled()) {
+      block.entryCount = reinterpret_cast<uint64_t *>(sRuntime->allocate(sizeof(uint64_t), 8));
+
+      if (block.entryCount) {
+         *block.entryCount = 0;
+         a.mov(asmjit::x86::rax, asmjit::Ptr(block.entryCount));
+         a.inc(asmjit::X86Mem(asmjit::x86::rax, 0, 8));
+         cacheable = false;
+      }
+   }
+
+   auto fpuMarked = false;
+
    for (lclCia = block.start; lclCia < block.end; lclCia += 4)
    {
       auto targetIter = targetLbls.find(lclCia);
       if (targetIter != targetLbls.end()) {
          // This is a jump target, we should flush any register caches
          //  and then also insert a label so we can find this location.
+         a.flushRetired();
+         a.evictAll();
          a.bind(targetIter->second.label);
+         fpuMarked = false;
       }
 
-      if (JIT_DEBUG) {
+      block.addressMap.emplace_back(static_cast<uint32_t>(a.getOffset()), lclCia);
+
+      // Verification compares nia after every instruction
+      if (JIT_DEBUG || gJitMode == jit_mode::verify) {
          a.mov(a.niaMem, lclCia + 4);
       }
 
@@ -399,6 +717,11 @@ gen(JitBlock &block)
       if (!data) {
          a.ud2();
       } else {
+         // Kernel call IDs are not stable between builds
+         if (data->id == espresso::InstructionID::kc) {
+            cacheable = false;
+         }
+
          // Don't attempt to verify non-repeatable instructions
          bool doVerify = (gJitMode == jit_mode::verify
                           && data->id != espresso::InstructionID::kc
@@ -409,18 +732,44 @@ gen(JitBlock &block)
          }
 
          a.genCia = lclCia;
+         a.pendingRetired++;
 
          auto genSuccess = false;
+         auto terminator = interpreter::isBlockTerminator(data->id);
+
+         if (traceRing && terminator) {
+            genTraceRecord(a, instr, data, false);
+         }
+
+         // Only the first floating point instruction reachable from each
+         //  entry into the block needs to mark the FPU as used.
+         if (data->usesFpr && !fpuMarked) {
+            a.mov(a.fpuUsedMem, 1);
+            fpuMarked = true;
+         }
 
          auto fptr = sInstructionMap[static_cast<size_t>(data->id)];
+         a.calledOut = false;
+
          if (fptr) {
             genSuccess = fptr(a, instr);
          }
 
+         // A kc, fallback or interrupt check may have switched context, and
+         //  restoreContext clears fpuUsed, so the next floating point
+         //  instruction must mark it again.
+         if (a.calledOut) {
+            fpuMarked = false;
+         }
+
          if (!genSuccess) {
             a.int3();
          }
 
+         if (traceRing && !terminator) {
+            genTraceRecord(a, instr, data, true);
+         }
+
          if (doVerify) {
             insertVerifyCall(a, instr, sPostInstr);
          }
@@ -435,6 +784,7 @@ gen(JitBlock &block)
       }
    }
 
+   a.flushRetired();
    jit_b_direct(a, lclCia);
 
    auto func = asmjit_cast<JitCode>(a.make());
@@ -447,41 +797,17 @@ gen(JitBlock &block)
    // Write in the relocation data that jumps to the Finale, which can
    //  later be overwritten atomically by the generator.
    for (auto &reloc : a.relocLabels) {
-      // We use a trick here to save some bytes.  We write the addr
-      //  part of the info while relocating in spite of being able
-      //  to do it during initial generation, this allows us to move
-      //  it to before or after the aligned MOV which saves us some
-      //  bytes that would otherwise be wasted on NOP's.
-
-      auto targetAddr = asmjit::Ptr(gFinaleFn);
-
       // Find our bytes of memory allocated above...
       auto mem = asmjit_cast<uint8_t*>(func, a.getLabelOffset(reloc.second));
-
-      auto aligned_offset = align_up(mem + 15 + 2, 8) - mem;
-      auto aligned_mov_offset = aligned_offset - 2;
-      auto aligned_base_offset = reinterpret_cast<intptr_t>(mem + aligned_offset);
-
-      // Copy the pregenerated relocation code bytes
-      std::copy(sBaseRelocCode.begin(), sBaseRelocCode.end(), mem);
-
-      // Write addr of `MOV finaleNiaArgReg, addr`
-      *reinterpret_cast<uint32_t*>(&mem[1]) = reloc.first;
-
-      // Write relmem of `MOV finaleJmpSrcArgReg, relmem`
-      *reinterpret_cast<intptr_t*>(&mem[7]) = aligned_base_offset;
-
-      // Write `MOV RAX, target`
-      mem[aligned_mov_offset + 0] = 0x48;
-      mem[aligned_mov_offset + 1] = 0xB8;
-      auto atomicAddr = &mem[aligned_mov_offset + 2];
-      decaf_check(align_up(atomicAddr, 8) == atomicAddr);
-      *reinterpret_cast<uint64_t*>(atomicAddr) = targetAddr;
+      auto slot = writeRelocation(mem, reloc.first);
+      block.relocations.emplace_back(reloc.first, slot);
    }
 
    // Calculate the starting address of the block
    auto baseAddr = asmjit_cast<JitCode>(func, a.getLabelOffset(codeStart));
    block.entry = baseAddr;
+   block.code = asmjit_cast<uint8_t *>(func);
+   block.codeSize = a.getCodeSize();
 
    // Generate all the offset labels for these relocations
    for (auto &target : targetLbls) {
@@ -491,47 +817,119 @@ gen(JitBlock &block)
       }
    }
 
+   if (cacheable) {
+      auto cached = CachedBlock { };
+      auto code = asmjit_cast<uint8_t *>(func);
+      cached.start = block.start;
+      cached.end = block.end;
+      cached.entryOffset = static_cast<uint32_t>(a.getLabelOffset(codeStart));
+      cached.code.assign(code, code + a.getCodeSize());
+      cached.addressMap = block.addressMap;
+
+      for (auto &reloc : a.relocLabels) {
+         cached.relocations.emplace_back(reloc.first, static_cast<uint32_t>(a.getLabelOffset(reloc.second)));
+      }
+
+      for (auto &target : targetLbls) {
+         if (a.isLabelBound(target.second.label)) {
+            cached.targets.emplace_back(target.first, static_cast<uint32_t>(a.getLabelOffset(target.second.label)));
+         }
+      }
+
+      addCachedBlock(std::move(cached));
+   }
+
    return true;
 }
 
+static bool
+isUnconditionalBranch(espresso::Instruction instr)
+{
+   // BO bits 2 and 4 disable the CTR and CR checks respectively
+   return (instr.bo & 0x14) == 0x14;
+}
+
 bool
 identBlock(JitBlock& block)
 {
    auto fnStart = block.start;
    auto fnEnd = fnStart;
    auto lclCia = fnStart;
+   auto maxRegionEnd = fnStart + JIT_MAX_INST * 4;
+
+   // The furthest forward branch target we have seen so far, if the block
+   //  would end before this we keep going as the code is still reachable.
+   auto lastForwardTarget = fnStart;
+   auto passedTerminator = false;
+   std::vector<uint32_t> jumpTargets;
 
    while (lclCia) {
       auto instr = mem::read<espresso::Instruction>(lclCia);
       auto data = espresso::decodeInstruction(instr);
 
       if (!data) {
-         // Looks like we found a tail call function??
-         fnEnd = lclCia + 4;
-         gLog->warn("Bailing on JIT {:08x} ident due to failed decode at {:08x}", block.start, lclCia);
+         if (passedTerminator) {
+            // We are past an unconditional branch, so this is most
+            //  likely data rather than an unreachable instruction.
+            fnEnd = lclCia;
+         } else {
+            // Looks like we found a tail call function??
+            fnEnd = lclCia + 4;
+            gLog->warn("Bailing on JIT {:08x} ident due to failed decode at {:08x}", block.start, lclCia);
+         }
          break;
       }
 
-      // Targets should be added to block.targets if we know of any...
+      auto isTerminator = false;
+      uint32_t target = 0;
+      auto hasTarget = false;
 
       switch (data->id) {
       case espresso::InstructionID::b:
+         target = sign_extend<26>(instr.li << 2);
+         if (!instr.aa) {
+            target += lclCia;
+         }
+
+         hasTarget = !instr.lk;
+         isTerminator = true;
+         break;
       case espresso::InstructionID::bc:
+         target = lclCia + sign_extend<16>(instr.bd << 2);
+         hasTarget = !instr.lk;
+         isTerminator = instr.lk || isUnconditionalBranch(instr);
+         break;
       case espresso::InstructionID::bcctr:
       case espresso::InstructionID::bclr:
-         fnEnd = lclCia + 4;
+         isTerminator = instr.lk || isUnconditionalBranch(instr);
          break;
       default:
          break;
       }
 
-      if (fnEnd != fnStart) {
-         // If we found an end, lets stop searching!
-         break;
+      if (hasTarget) {
+         jumpTargets.push_back(target);
+
+         // Only an earlier forward branch keeps the region open past a
+         //  terminator, a terminator's own target (e.g. a tail call) must
+         //  not pull whatever follows it into the block.
+         if (!isTerminator && target > lastForwardTarget && target < maxRegionEnd) {
+            lastForwardTarget = target;
+         }
       }
 
       lclCia += 4;
 
+      if (isTerminator) {
+         if (lastForwardTarget < lclCia) {
+            // If we found an end, lets stop searching!
+            fnEnd = lclCia;
+            break;
+         }
+
+         passedTerminator = true;
+      }
+
       if (((lclCia - fnStart) >> 2) > JIT_MAX_INST) {
          fnEnd = lclCia;
          gLog->trace("Bailing on JIT {:08x} due to max instruction limit at {:08x}", block.start, lclCia);
@@ -541,9 +939,282 @@ identBlock(JitBlock& block)
 
    block.end = fnEnd;
 
+   // Any branch which lands inside this region becomes an internal jump
+   //  target, this lets loops run without going back to the dispatcher.
+   std::sort(jumpTargets.begin(), jumpTargets.end());
+   jumpTargets.erase(std::unique(jumpTargets.begin(), jumpTargets.end()), jumpTargets.end());
+
+   for (auto target : jumpTargets) {
+      if (target >= block.start && target < block.end) {
+         block.targets.emplace_back(target, nullptr);
+      }
+   }
+
    return true;
 }
 
+// Returns true if ptr lies within a block which has not been invalidated,
+//  sBlockMutex must be held.
+static bool
+isLiveCode(void *ptr)
+{
+   auto code = reinterpret_cast<uint8_t *>(ptr);
+   auto itr = sBlockInfo.upper_bound(code);
+
+   if (itr == sBlockInfo.begin()) {
+      return false;
+   }
+
+   --itr;
+   return code < itr->second.codeEnd;
+}
+
+// Forget about a linked relocation slot without modifying it,
+//  sBlockMutex must be held.
+static void
+forgetRelocation(JitCode *slot)
+{
+   auto itr = sLinkTargets.find(slot);
+
+   if (itr == sLinkTargets.end()) {
+      return;
+   }
+
+   auto &sources = sLinkSources[itr->second];
+   sources.erase(std::remove(sources.begin(), sources.end(), slot), sources.end());
+
+   if (sources.empty()) {
+      sLinkSources.erase(itr->second);
+   }
+
+   sLinkTargets.erase(itr);
+}
+
+// Point a relocation slot directly at target, sBlockMutex must be held.
+static void
+linkRelocation(JitCode *slot, JitCode target)
+{
+   forgetRelocation(slot);
+
+   // Aligned writes on x64 are guarenteed to be atomic
+   *slot = target;
+
+   sLinkTargets.emplace(slot, target);
+   sLinkSources[target].push_back(slot);
+}
+
+// Returns false without registering the block if any page it was built from
+//  was invalidated after serial, as the block may have been generated from
+//  stale guest code.
+static bool
+registerBlock(const JitBlock &block,
+              uint64_t serial)
+{
+   std::unique_lock<std::mutex> lock { sBlockMutex };
+   auto end = std::max(block.end, block.start + 4);
+
+   for (auto page = block.start >> JIT_PAGE_SHIFT; page <= (end - 1) >> JIT_PAGE_SHIFT; ++page) {
+      auto itr = sPageInvalidations.find(page);
+
+      if (itr != sPageInvalidations.end() && itr->second > serial) {
+         return false;
+      }
+   }
+
+   auto info = JitBlockInfo { };
+   info.start = block.start;
+   info.end = end;
+   info.codeStart = block.code;
+   info.codeEnd = block.code + block.codeSize;
+   info.addressMap = block.addressMap;
+   info.entryCount = block.entryCount;
+   info.entries.emplace_back(block.start, block.entry);
+
+   for (auto &target : block.targets) {
+      if (target.second) {
+         info.entries.emplace_back(target.first, target.second);
+      }
+   }
+
+   for (auto &entry : info.entries) {
+      sJitBlocks.set(entry.first, entry.second);
+   }
+
+   // Link any exits to blocks which we already know about, rather
+   //  than wasting time going through the JIT dispatcher!
+   if (!gBranchTraceHandler) {
+      for (auto &reloc : block.relocations) {
+         auto target = sJitBlocks.find(reloc.first);
+
+         if (target) {
+            linkRelocation(reloc.second, target);
+         }
+      }
+   }
+
+   for (auto page = info.start >> JIT_PAGE_SHIFT; page <= (info.end - 1) >> JIT_PAGE_SHIFT; ++page) {
+      sPageBlocks[page].push_back(info.codeStart);
+   }
+
+   sBlockInfo.emplace(info.codeStart, std::move(info));
+   return true;
+}
+
+// Removes a block so it will be regenerated the next time it is needed,
+//  sBlockMutex must be held.  The host code is never freed as another
+//  core may still be executing it, such a core will return to the
+//  dispatcher at the next exit from the block.
+static void
+invalidateBlock(uint8_t *code)
+{
+   auto itr = sBlockInfo.find(code);
+   decaf_check(itr != sBlockInfo.end());
+   auto &info = itr->second;
+   sBlockGeneration.fetch_add(1, std::memory_order_release);
+
+   for (auto &entry : info.entries) {
+      // Only remove the mapping if it has not been replaced already
+      if (sJitBlocks.find(entry.first) == entry.second) {
+         sJitBlocks.set(entry.first, nullptr);
+      }
+
+      // Send any jumps into this block back through the Finale
+      auto sources = sLinkSources.find(entry.second);
+
+      if (sources != sLinkSources.end()) {
+         for (auto slot : sources->second) {
+            *slot = gFinaleFn;
+            sLinkTargets.erase(slot);
+         }
+
+         sLinkSources.erase(sources);
+      }
+   }
+
+   // Forget about jumps out of this block
+   auto first = sLinkTargets.lower_bound(reinterpret_cast<JitCode *>(info.codeStart));
+   auto last = sLinkTargets.lower_bound(reinterpret_cast<JitCode *>(info.codeEnd));
+
+   while (first != last) {
+      forgetRelocation((first++)->first);
+   }
+
+   for (auto page = info.start >> JIT_PAGE_SHIFT; page <= (info.end - 1) >> JIT_PAGE_SHIFT; ++page) {
+      auto &blocks = sPageBlocks[page];
+      blocks.erase(std::remove(blocks.begin(), blocks.end(), code), blocks.end());
+
+      if (blocks.empty()) {
+         sPageBlocks.erase(page);
+      }
+   }
+
+   sBlockInfo.erase(itr);
+}
+
+std::vector<JitBlockProfile>
+getProfile()
+{
+   std::unique_lock<std::mutex> lock { sBlockMutex };
+   auto profile = std::vector<JitBlockProfile> { };
+
+   for (auto &itr : sBlockInfo) {
+      auto &info = itr.second;
+
+      if (info.entryCount) {
+         profile.push_back(JitBlockProfile { info.start, info.end, *info.entryCount });
+      }
+   }
+
+   return profile;
+}
+
+void
+resetProfile()
+{
+   std::unique_lock<std::mutex> lock { sBlockMutex };
+
+   for (auto &itr : sBlockInfo) {
+      if (itr.second.entryCount) {
+         *itr.second.entryCount = 0;
+      }
+   }
+}
+
+bool
+findGuestAddress(const void *host, uint32_t &address)
+{
+   std::unique_lock<std::mutex> lock { sBlockMutex };
+   auto code = reinterpret_cast<uint8_t *>(const_cast<void *>(host));
+
+   if (!isLiveCode(code)) {
+      return false;
+   }
+
+   auto &info = std::prev(sBlockInfo.upper_bound(code))->second;
+   auto offset = static_cast<uint32_t>(code - info.codeStart);
+
+   // Find the last instruction which starts at or before offset
+   auto itr = std::upper_bound(info.addressMap.begin(), info.addressMap.end(), offset,
+                               [](uint32_t offset, const std::pair<uint32_t, uint32_t> &entry) {
+                                  return offset < entry.first;
+                               });
+
+   if (itr == info.addressMap.begin()) {
+      return false;
+   }
+
+   address = std::prev(itr)->second;
+   return true;
+}
+
+void
+recoverPinnedRegisters(Core *core, const uint64_t *hostGpr)
+{
+   // Pinned registers are only written back to Core when leaving generated
+   //  code, so after a fault the host registers hold the real values.
+   for (auto i = 0u; i < JitPinnedGprs.size(); ++i) {
+      core->gpr[JitPinnedGprs[i]] = static_cast<uint32_t>(hostGpr[JitPinnedHostRegIndex + i]);
+   }
+}
+
+void
+invalidateRange(uint32_t address, uint32_t size)
+{
+   if (!size) {
+      return;
+   }
+
+   std::unique_lock<std::mutex> lock { sBlockMutex };
+   auto last = address + (size - 1);
+   auto invalidated = std::vector<uint8_t *> { };
+   auto serial = sInvalidationSerial.fetch_add(1, std::memory_order_acq_rel) + 1;
+
+   for (auto page = address >> JIT_PAGE_SHIFT; page <= last >> JIT_PAGE_SHIFT; ++page) {
+      sPageInvalidations[page] = serial;
+
+      auto blocks = sPageBlocks.find(page);
+
+      if (blocks == sPageBlocks.end()) {
+         continue;
+      }
+
+      for (auto code : blocks->second) {
+         auto &info = sBlockInfo[code];
+
+         if (info.start <= last && info.end > address) {
+            invalidated.push_back(code);
+         }
+      }
+   }
+
+   std::sort(invalidated.begin(), invalidated.end());
+   invalidated.erase(std::unique(invalidated.begin(), invalidated.end()), invalidated.end());
+
+   for (auto code : invalidated) {
+      invalidateBlock(code);
+   }
+}
+
 JitCode
 get(uint32_t addr)
 {
@@ -552,25 +1223,153 @@ get(uint32_t addr)
       return foundBlock;
    }
 
-   auto block = JitBlock { addr };
+   while (true) {
+      auto block = JitBlock { addr };
+      auto serial = getInvalidationSerial();
 
-   if (!identBlock(block)) {
-      return nullptr;
-   }
+      if (!identBlock(block)) {
+         return nullptr;
+      }
 
-   if (!gen(block)) {
-      return nullptr;
+      if (!gen(block)) {
+         return nullptr;
+      }
+
+      // The guest code was modified while we were generating, the host
+      //  code we just wasted is never freed as with invalidateBlock.
+      if (!registerBlock(block, serial)) {
+         continue;
+      }
+
+      writePerfMapEntry(block.code, block.codeSize, block.start);
+      return block.entry;
    }
+}
 
-   sJitBlocks.set(addr, block.entry);
+static void
+compilerEntryPoint()
+{
+   std::unique_lock<std::mutex> lock { sCompilerMutex };
 
-   for (auto i = block.targets.cbegin(); i != block.targets.cend(); ++i) {
-      if (i->second) {
-         sJitBlocks.set(i->first, i->second);
+   while (sCompilerRunning) {
+      if (sCompilerQueue.empty()) {
+         sCompilerCondition.wait(lock);
+         continue;
       }
+
+      auto addr = sCompilerQueue.front();
+      sCompilerQueue.pop_front();
+
+      // Compile without holding the lock so the cores can keep queueing,
+      //  the block gets published to sJitBlocks by get.
+      lock.unlock();
+      get(addr);
+      lock.lock();
+
+      sCompilerQueued.erase(addr);
+   }
+}
+
+static void
+startCompiler()
+{
+   sCompilerRunning = true;
+   sCompilerThread = std::thread { compilerEntryPoint };
+   platform::setThreadName(&sCompilerThread, "JIT Compiler");
+}
+
+static void
+queueCompile(uint32_t addr)
+{
+   std::unique_lock<std::mutex> lock { sCompilerMutex };
+
+   if (!sCompilerRunning || !sCompilerQueued.insert(addr).second) {
+      return;
    }
 
-   return block.entry;
+   sCompilerQueue.push_back(addr);
+   sCompilerCondition.notify_one();
+}
+
+// Counts an interpreted entry into a block, once it gets hot enough
+//  it is handed to the compiler thread.
+static void
+countBlockEntry(uint32_t addr)
+{
+   auto &count = tBlockCounters[addr];
+
+   if (++count >= JIT_TIER_THRESHOLD) {
+      // Reset so that a block which is later invalidated, or which failed
+      //  to compile, has to warm up again before being requeued.
+      count = 0;
+      queueCompile(addr);
+   }
+}
+
+void
+shutdown()
+{
+   {
+      std::unique_lock<std::mutex> lock { sCompilerMutex };
+      sCompilerRunning = false;
+      sCompilerQueue.clear();
+      sCompilerQueued.clear();
+   }
+
+   sCompilerCondition.notify_all();
+
+   if (sCompilerThread.joinable()) {
+      sCompilerThread.join();
+   }
+}
+
+uint64_t
+getInvalidationSerial()
+{
+   return sInvalidationSerial.load(std::memory_order_acquire);
+}
+
+bool
+loadCachedBlock(const CachedBlock &cached,
+                uint64_t serial)
+{
+   if (sJitBlocks.find(cached.start)) {
+      return false;
+   }
+
+   auto code = reinterpret_cast<uint8_t *>(sRuntime->allocate(cached.code.size(), 8));
+
+   if (!code) {
+      gLog->error("JIT cache failed to allocate {} bytes for block {:08x}", cached.code.size(), cached.start);
+      return false;
+   }
+
+   std::copy(cached.code.begin(), cached.code.end(), code);
+
+   auto block = JitBlock { cached.start };
+   block.end = cached.end;
+   block.entry = code + cached.entryOffset;
+   block.code = code;
+   block.codeSize = cached.code.size();
+   block.addressMap = cached.addressMap;
+
+   // Exits are reset back to the Finale, they get linked to their
+   //  target blocks again while registering.
+   for (auto &reloc : cached.relocations) {
+      auto slot = writeRelocation(code + reloc.second, reloc.first);
+      block.relocations.emplace_back(reloc.first, slot);
+   }
+
+   for (auto &target : cached.targets) {
+      block.targets.emplace_back(target.first, code + target.second);
+   }
+
+   if (!registerBlock(block, serial)) {
+      return false;
+   }
+
+   writePerfMapEntry(block.code, block.codeSize, block.start);
+   return true;
 }
 
 JitCode
@@ -584,15 +1383,32 @@ jit_continue(uint32_t nia, JitCode *jumpSource)
       gBranchTraceHandler(nia);
    }
 
-   // Locate or generate the next JIT section
-   JitCode jitFn = get(nia);
+   // Locate or generate the next JIT section, in tiered mode cold code
+   //  is left to the interpreter until the compiler thread publishes it.
+   JitCode jitFn = nullptr;
+
+   if (gJitMode == jit_mode::tiered) {
+      jitFn = sJitBlocks.find(nia);
+
+      if (!jitFn) {
+         countBlockEntry(nia);
+         return nullptr;
+      }
+   } else {
+      jitFn = get(nia);
+   }
 
    // We do not update the jumpSource if branch tracing is enabled,
    //  this is because it would cause those branches to avoid calling
    //  here ever again...
-   if (jumpSource && !gBranchTraceHandler) {
-      // Aligned writes on x64 are guarenteed to be atomic
-      *jumpSource = jitFn;
+   if (jitFn && jumpSource && !gBranchTraceHandler) {
+      std::unique_lock<std::mutex> lock { sBlockMutex };
+
+      // Either block may have been invalidated by another core since
+      //  we looked it up, in which case we must not link them.
+      if (sJitBlocks.find(nia) == jitFn && isLiveCode(jumpSource)) {
+         linkRelocation(jumpSource, jitFn);
+      }
    }
 
    return jitFn;
@@ -604,6 +1420,26 @@ execute(Core *core, JitCode block)
    return gCallFn(core, block);
 }
 
+static void
+dispatch(Core *core)
+{
+   while (core->nia != CALLBACK_ADDR) {
+      JitCode jitFn = jit_continue(core->nia, nullptr);
+
+      if (jitFn) {
+         core = execute(core, jitFn);
+         continue;
+      }
+
+      // There is no code for this block yet, so run it in the interpreter
+      //  until it branches somewhere, then check again.
+      core = interpreter::step_block(core);
+   }
+
+   decaf_check(core == this_core::state());
+   decaf_check(core->nia == CALLBACK_ADDR);
+}
+
 void
 resume()
 {
@@ -618,12 +1454,49 @@ resume()
    core->cia = 0xFFFFFFFD;
 
    decaf_check(core->nia != CALLBACK_ADDR);
+   dispatch(core);
+}
 
-   JitCode jitFn = jit_continue(core->nia, nullptr);
-   core = execute(core, jitFn);
+// Lighter version of resume for calls from the host into a guest function,
+//  the entry block is taken from tSubCallCache while it is still valid.
+//  Host exception flags are still cleared, the call may come from the middle
+//  of HLE code whose flags must not leak into the callee's FPSCR.
+void
+resumeSub()
+{
+   this_core::updateRoundingMode();
+   std::feclearexcept(FE_ALL_EXCEPT);
 
-   decaf_check(core == this_core::state());
-   decaf_check(core->nia == CALLBACK_ADDR);
+   auto core = this_core::state();
+   core->cia = 0xFFFFFFFD;
+
+   decaf_check(core->nia != CALLBACK_ADDR);
+
+   auto generation = sBlockGeneration.load(std::memory_order_acquire);
+   auto &entry = tSubCallCache[(core->nia >> 2) & (SubCallCacheSize - 1)];
+   JitCode jitFn = nullptr;
+
+   if (entry.address == core->nia && entry.generation == generation && !gBranchTraceHandler) {
+      jitFn = entry.code;
+   } else {
+      jitFn = jit_continue(core->nia, nullptr);
+
+      // Cold code in tiered mode is not cached, so that we pick up the
+      //  block once the compiler thread has published it.
+      if (jitFn) {
+         entry.address = core->nia;
+         entry.generation = generation;
+         entry.code = jitFn;
+      }
+   }
+
+   if (jitFn) {
+      core = execute(core, jitFn);
+   } else {
+      core = interpreter::step_block(core);
+   }
+
+   dispatch(core);
 }
 
 bool
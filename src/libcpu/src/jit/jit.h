@@ -11,12 +11,36 @@ namespace jit
 void
 initialise();
 
+void
+shutdown();
+
 void
 clearCache();
 
+void
+invalidateRange(uint32_t address,
+                uint32_t size);
+
+bool
+findGuestAddress(const void *host,
+                 uint32_t &address);
+
+void
+recoverPinnedRegisters(Core *core,
+                       const uint64_t *hostGpr);
+
+std::vector<JitBlockProfile>
+getProfile();
+
+void
+resetProfile();
+
 void
 resume();
 
+void
+resumeSub();
+
 bool
 hasInstruction(espresso::InstructionID instrId);
 
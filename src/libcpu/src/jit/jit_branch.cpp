@@ -37,6 +37,7 @@ jit_b_check_interrupt(PPCEmuAssembler& a)
    // We need to evict everything in case we call back to the
    //  interrupt handler which is C++ code...
    a.evictAll();
+   a.flushRetired();
 
    // Jump to interrupt handler if there is an interrupt
    auto noInterrupt = a.newLabel();
@@ -45,8 +46,10 @@ jit_b_check_interrupt(PPCEmuAssembler& a)
    a.je(noInterrupt);
 
    a.mov(a.niaMem, a.genCia + 4);
-   a.call(asmjit::Ptr(jit_interrupt_stub));
+   a.spillPinned();
+   a.call(a.importRef(asmjit::x86::rax, offsetof2(JitImports, interruptStub)));
    a.mov(a.stateReg, asmjit::x86::rax);
+   a.reloadPinned();
 
    a.bind(noInterrupt);
 }
@@ -136,7 +139,7 @@ bcGeneric(PPCEmuAssembler& a, Instruction instr)
 
       a.and_(a.finaleNiaArgReg, ~0x3);
       a.mov(a.finaleJmpSrcArgReg, 0);
-      a.jmp(asmjit::Ptr(cpu::jit::gFinaleFn));
+      a.jmp(a.importRef(asmjit::x86::rax, offsetof2(JitImports, finaleFn)));
    } else {
       if (instr.lk) {
          auto tmp = a.allocGpTmp().r32();
@@ -173,6 +176,8 @@ bclr(PPCEmuAssembler& a, Instruction instr)
 
 void registerBranchInstructions()
 {
+   gJitImports.interruptStub = reinterpret_cast<void *>(&jit_interrupt_stub);
+
    RegisterInstruction(b);
    RegisterInstruction(bc);
    RegisterInstruction(bcctr);
@@ -0,0 +1,400 @@
+#include "cpu.h"
+#include "cpu_internal.h"
+#include "jit_cache.h"
+#include "jit_float.h"
+#include "jit_host.h"
+#include "mem.h"
+#include "state.h"
+
+#include <algorithm>
+#include <common/log.h>
+#include <common/murmur3.h>
+#include <common/platform_dir.h>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <spdlog/fmt/fmt.h>
+
+namespace cpu
+{
+
+namespace jit
+{
+
+// Bump this whenever code generation changes in a way which makes
+//  previously cached blocks incompatible.
+static const uint32_t JIT_CACHE_VERSION = 10;
+
+// Size of the relocation stubs written by the generator
+static const uint32_t JIT_RELOCATION_SIZE = 32;
+
+static const uint32_t JIT_CACHE_MAGIC = 0x4A495443; // "JITC"
+
+enum JitCacheFlags : uint32_t
+{
+   JitCacheFlagFMA3 = 1 << 0,
+   JitCacheFlagMOVBE = 1 << 1,
+   JitCacheFlagBMI2 = 1 << 2,
+   JitCacheFlagAVX = 1 << 3,
+   JitCacheFlagVirtualTime = 1 << 4,
+   JitCacheFlagTraceRing = 1 << 5,
+};
+
+#pragma pack(push, 1)
+
+struct CacheFileHeader
+{
+   uint32_t magic;
+   uint32_t version;
+   uint32_t flags;
+   uint32_t coreSize;
+   uint32_t start;
+   uint32_t size;
+   uint32_t numBlocks;
+};
+
+struct CacheBlockHeader
+{
+   uint32_t start;
+   uint32_t end;
+   uint32_t entryOffset;
+   uint32_t codeSize;
+   uint32_t numRelocations;
+   uint32_t numTargets;
+   uint32_t numAddresses;
+};
+
+#pragma pack(pop)
+
+struct CacheRegion
+{
+   uint32_t start;
+   uint32_t size;
+   uint64_t hash[2];
+   std::map<uint32_t, CachedBlock> blocks;
+   bool dirty;
+};
+
+static std::string
+sCacheDirectory;
+
+static std::mutex
+sCacheMutex;
+
+static std::vector<CacheRegion>
+sCacheRegions;
+
+static void
+hashRegion(uint32_t start,
+           uint32_t size,
+           uint64_t hash[2])
+{
+   MurmurHash3_x64_128(mem::translate(start), size, JIT_CACHE_VERSION, hash);
+}
+
+static uint32_t
+getCacheFlags()
+{
+   auto flags = 0u;
+
+   if (hostHasFMA3()) {
+      flags |= JitCacheFlagFMA3;
+   }
+
+   if (hostHasMOVBE()) {
+      flags |= JitCacheFlagMOVBE;
+   }
+
+   if (hostHasBMI2()) {
+      flags |= JitCacheFlagBMI2;
+   }
+
+   if (hostHasAVX()) {
+      flags |= JitCacheFlagAVX;
+   }
+
+   if (gVirtualTime) {
+      flags |= JitCacheFlagVirtualTime;
+   }
+
+   if (isJitTraceRingEnabled()) {
+      flags |= JitCacheFlagTraceRing;
+   }
+
+   return flags;
+}
+
+static std::string
+getCachePath(const CacheRegion &region)
+{
+   return fmt::format("{}/{:016x}{:016x}.jitcache", sCacheDirectory, region.hash[0], region.hash[1]);
+}
+
+template<typename Type>
+static bool
+readValue(std::ifstream &file, Type &value)
+{
+   file.read(reinterpret_cast<char *>(&value), sizeof(Type));
+   return !!file;
+}
+
+template<typename Type>
+static void
+writeValue(std::ofstream &file, const Type &value)
+{
+   file.write(reinterpret_cast<const char *>(&value), sizeof(Type));
+}
+
+static bool
+readPairs(std::ifstream &file,
+          std::vector<std::pair<uint32_t, uint32_t>> &pairs,
+          uint32_t count)
+{
+   pairs.resize(count);
+
+   for (auto &pair : pairs) {
+      if (!readValue(file, pair.first) || !readValue(file, pair.second)) {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+static void
+writePairs(std::ofstream &file,
+           const std::vector<std::pair<uint32_t, uint32_t>> &pairs)
+{
+   for (auto &pair : pairs) {
+      writeValue(file, pair.first);
+      writeValue(file, pair.second);
+   }
+}
+
+static bool
+readRegion(CacheRegion &region)
+{
+   auto path = getCachePath(region);
+   auto file = std::ifstream { path, std::ifstream::in | std::ifstream::binary };
+
+   if (!file.is_open()) {
+      return false;
+   }
+
+   auto header = CacheFileHeader { };
+
+   if (!readValue(file, header)
+    || header.magic != JIT_CACHE_MAGIC
+    || header.version != JIT_CACHE_VERSION
+    || header.flags != getCacheFlags()
+    || header.coreSize != sizeof(Core)
+    || header.start != region.start
+    || header.size != region.size) {
+      gLog->warn("Ignoring incompatible JIT cache {}", path);
+      return false;
+   }
+
+   for (auto i = 0u; i < header.numBlocks; ++i) {
+      auto blockHeader = CacheBlockHeader { };
+      auto block = CachedBlock { };
+
+      if (!readValue(file, blockHeader)) {
+         break;
+      }
+
+      block.start = blockHeader.start;
+      block.end = blockHeader.end;
+      block.entryOffset = blockHeader.entryOffset;
+      block.code.resize(blockHeader.codeSize);
+
+      if (blockHeader.start < region.start
+       || blockHeader.end > region.start + region.size
+       || blockHeader.entryOffset >= blockHeader.codeSize) {
+         break;
+      }
+
+      if (!file.read(reinterpret_cast<char *>(block.code.data()), block.code.size())
+       || !readPairs(file, block.relocations, blockHeader.numRelocations)
+       || !readPairs(file, block.targets, blockHeader.numTargets)
+       || !readPairs(file, block.addressMap, blockHeader.numAddresses)) {
+         break;
+      }
+
+      auto isValidRelocation = [&](const std::pair<uint32_t, uint32_t> &pair) {
+         return pair.second + JIT_RELOCATION_SIZE <= blockHeader.codeSize;
+      };
+
+      auto isValidTarget = [&](const std::pair<uint32_t, uint32_t> &pair) {
+         return pair.second < blockHeader.codeSize;
+      };
+
+      if (!std::all_of(block.relocations.begin(), block.relocations.end(), isValidRelocation)
+       || !std::all_of(block.targets.begin(), block.targets.end(), isValidTarget)) {
+         break;
+      }
+
+      region.blocks.emplace(block.start, std::move(block));
+   }
+
+   if (region.blocks.size() != header.numBlocks) {
+      gLog->warn("Truncated JIT cache {}, loaded {} of {} blocks", path, region.blocks.size(), header.numBlocks);
+   }
+
+   return true;
+}
+
+static void
+writeRegion(const CacheRegion &region)
+{
+   auto path = getCachePath(region);
+   auto file = std::ofstream { path, std::ofstream::out | std::ofstream::binary };
+
+   if (!file.is_open()) {
+      gLog->error("Could not open JIT cache {} for writing", path);
+      return;
+   }
+
+   auto header = CacheFileHeader { };
+   header.magic = JIT_CACHE_MAGIC;
+   header.version = JIT_CACHE_VERSION;
+   header.flags = getCacheFlags();
+   header.coreSize = static_cast<uint32_t>(sizeof(Core));
+   header.start = region.start;
+   header.size = region.size;
+   header.numBlocks = static_cast<uint32_t>(region.blocks.size());
+   writeValue(file, header);
+
+   for (auto &itr : region.blocks) {
+      auto &block = itr.second;
+      auto blockHeader = CacheBlockHeader { };
+      blockHeader.start = block.start;
+      blockHeader.end = block.end;
+      blockHeader.entryOffset = block.entryOffset;
+      blockHeader.codeSize = static_cast<uint32_t>(block.code.size());
+      blockHeader.numRelocations = static_cast<uint32_t>(block.relocations.size());
+      blockHeader.numTargets = static_cast<uint32_t>(block.targets.size());
+      blockHeader.numAddresses = static_cast<uint32_t>(block.addressMap.size());
+      writeValue(file, blockHeader);
+
+      file.write(reinterpret_cast<const char *>(block.code.data()), block.code.size());
+      writePairs(file, block.relocations);
+      writePairs(file, block.targets);
+      writePairs(file, block.addressMap);
+   }
+}
+
+bool
+isCacheEnabled()
+{
+   return !sCacheDirectory.empty();
+}
+
+void
+setCacheDirectory(const std::string &path)
+{
+   std::unique_lock<std::mutex> lock { sCacheMutex };
+   sCacheDirectory = path;
+
+   if (!sCacheDirectory.empty()) {
+      platform::createDirectory(sCacheDirectory);
+   }
+}
+
+void
+addCacheRegion(uint32_t start,
+               uint32_t size)
+{
+   if (!isCacheEnabled() || !size) {
+      return;
+   }
+
+   std::unique_lock<std::mutex> lock { sCacheMutex };
+   auto region = CacheRegion { };
+   region.start = start;
+   region.size = size;
+   region.dirty = false;
+
+   auto serial = getInvalidationSerial();
+   hashRegion(start, size, region.hash);
+
+   if (readRegion(region)) {
+      auto loaded = 0u;
+
+      for (auto &itr : region.blocks) {
+         if (loadCachedBlock(itr.second, serial)) {
+            ++loaded;
+         }
+      }
+
+      gLog->debug("Loaded {} JIT blocks from cache for region {:08x}-{:08x}", loaded, start, start + size);
+   }
+
+   sCacheRegions.emplace_back(std::move(region));
+}
+
+void
+addCachedBlock(CachedBlock &&block)
+{
+   std::unique_lock<std::mutex> lock { sCacheMutex };
+
+   for (auto &region : sCacheRegions) {
+      if (block.start < region.start || block.end > region.start + region.size) {
+         continue;
+      }
+
+      if (region.blocks.find(block.start) == region.blocks.end()) {
+         region.blocks.emplace(block.start, std::move(block));
+         region.dirty = true;
+      }
+
+      return;
+   }
+}
+
+void
+saveCache()
+{
+   std::unique_lock<std::mutex> lock { sCacheMutex };
+
+   for (auto &region : sCacheRegions) {
+      if (!region.dirty) {
+         continue;
+      }
+
+      // Code which was modified at runtime can not be keyed by the hash
+      //  it had when loaded, so just drop it.
+      uint64_t hash[2];
+      hashRegion(region.start, region.size, hash);
+
+      if (hash[0] != region.hash[0] || hash[1] != region.hash[1]) {
+         gLog->debug("Not saving JIT cache for modified region {:08x}-{:08x}", region.start, region.start + region.size);
+         continue;
+      }
+
+      writeRegion(region);
+      region.dirty = false;
+   }
+}
+
+} // namespace jit
+
+void
+setJitCacheDirectory(const std::string &path)
+{
+   jit::setCacheDirectory(path);
+}
+
+void
+addJitCacheRegion(ppcaddr_t start,
+                  uint32_t size)
+{
+   jit::addCacheRegion(start, size);
+}
+
+void
+saveJitCache()
+{
+   jit::saveCache();
+}
+
+} // namespace cpu
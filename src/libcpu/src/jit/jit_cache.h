@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cpu
+{
+
+namespace jit
+{
+
+// A relocatable copy of a generated block, all offsets are relative
+//  to the start of the code buffer.
+struct CachedBlock
+{
+   uint32_t start;
+   uint32_t end;
+   uint32_t entryOffset;
+   std::vector<uint8_t> code;
+
+   // Pairs of guest address and code offset
+   std::vector<std::pair<uint32_t, uint32_t>> relocations;
+   std::vector<std::pair<uint32_t, uint32_t>> targets;
+
+   // Pairs of code offset and guest address
+   std::vector<std::pair<uint32_t, uint32_t>> addressMap;
+};
+
+bool
+isCacheEnabled();
+
+void
+setCacheDirectory(const std::string &path);
+
+void
+addCacheRegion(uint32_t start,
+               uint32_t size);
+
+void
+addCachedBlock(CachedBlock &&block);
+
+void
+saveCache();
+
+// Snapshot to pass to loadCachedBlock, taken before hashing the guest code
+uint64_t
+getInvalidationSerial();
+
+bool
+loadCachedBlock(const CachedBlock &block,
+                uint64_t serial);
+
+} // namespace jit
+
+} // namespace cpu
@@ -26,19 +26,37 @@ bool jit_fallback(PPCEmuAssembler& a, espresso::Instruction instr)
    decaf_assert(fptr, fmt::format("Unimplemented instruction {}", static_cast<int>(data->id)));
 
    a.evictAll();
+   a.flushRetired();
 
    if (TRACK_FALLBACK_CALLS) {
-      auto fallbackAddr = reinterpret_cast<intptr_t>(&sFallbackCalls[static_cast<uint32_t>(data->id)]);
-      a.mov(asmjit::x86::rax, asmjit::Ptr(fallbackAddr));
-      a.lock().inc(asmjit::X86Mem(asmjit::x86::rax, 0));
+      auto fallbackOffset = static_cast<int32_t>(sizeof(uint64_t) * static_cast<uint32_t>(data->id));
+      a.mov(asmjit::x86::rax, a.importRef(asmjit::x86::rax, offsetof2(JitImports, fallbackCalls)));
+      a.lock().inc(asmjit::X86Mem(asmjit::x86::rax, fallbackOffset));
    }
 
+   // Generated code does not keep nia up to date, but the interpreter
+   //  handlers expect it to be.
+   a.mov(a.niaMem, a.genCia + 4);
+   a.spillPinned();
+
    a.mov(a.sysArgReg[0], a.stateReg);
    a.mov(a.sysArgReg[1], (uint32_t)instr);
-   a.call(asmjit::Ptr(fptr));
+   a.call(a.importRef(asmjit::x86::rax, importFallbackOffset(data->id)));
+   a.reloadPinned();
    return true;
 }
 
+void
+initialiseFallbackImports(JitImports &imports)
+{
+   imports.fallbackCalls = sFallbackCalls;
+
+   for (auto i = 0u; i < static_cast<uint32_t>(espresso::InstructionID::InstructionCount); ++i) {
+      auto id = static_cast<espresso::InstructionID>(i);
+      imports.fallbackFn[i] = reinterpret_cast<void *>(cpu::interpreter::getInstructionHandler(id));
+   }
+}
+
 } // namespace jit
 
 uint64_t *
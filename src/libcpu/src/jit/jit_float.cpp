@@ -1,5 +1,6 @@
 #include "jit_insreg.h"
 #include "jit_float.h"
+#include "jit_host.h"
 #include <common/bitutils.h>
 #include <common/decaf_assert.h>
 #include <common/log.h>
@@ -11,7 +12,7 @@ namespace cpu
 namespace jit
 {
 
-static bool
+bool
 hostHasFMA3()
 {
    static bool checked = false;
@@ -122,32 +123,58 @@ fpArithGeneric(PPCEmuAssembler& a, Instruction instr)
 
    // FPSCR, FPRF supposed to be updated here...
 
-   auto tmpSrcA = a.allocXmmTmp(a.loadRegisterRead(a.fprps[instr.frA]));
+   // With AVX the three operand forms save us copying frA first
+   auto useAVX = hostHasAVX();
+   auto tmpSrcA = useAVX ? a.allocXmmTmp() : a.allocXmmTmp(a.loadRegisterRead(a.fprps[instr.frA]));
 
    switch (op) {
    case FPAdd: {
       auto srcB = a.loadRegisterRead(a.fprps[instr.frB]);
-      a.addsd(tmpSrcA, srcB);
+      if (useAVX) {
+         a.vaddsd(tmpSrcA, a.loadRegisterRead(a.fprps[instr.frA]), srcB);
+      } else {
+         a.addsd(tmpSrcA, srcB);
+      }
       break;
    }
    case FPSub: {
       auto srcB = a.loadRegisterRead(a.fprps[instr.frB]);
-      a.subsd(tmpSrcA, srcB);
+      if (useAVX) {
+         a.vsubsd(tmpSrcA, a.loadRegisterRead(a.fprps[instr.frA]), srcB);
+      } else {
+         a.subsd(tmpSrcA, srcB);
+      }
       break;
    }
    case FPMul: {
-      auto tmpSrcC = a.allocXmmTmp(a.loadRegisterRead(a.fprps[instr.frC]));
       if (ShouldRound) {
          // PPC has this weird behaviour with fmuls where it truncates the
          //  RHS operator to 24-bits of mantissa before multiplying...
+         auto tmpSrcC = a.allocXmmTmp(a.loadRegisterRead(a.fprps[instr.frC]));
          roundTo24BitSd(a, tmpSrcC);
+
+         if (useAVX) {
+            a.vmulsd(tmpSrcA, a.loadRegisterRead(a.fprps[instr.frA]), tmpSrcC);
+         } else {
+            a.mulsd(tmpSrcA, tmpSrcC);
+         }
+      } else {
+         auto srcC = a.loadRegisterRead(a.fprps[instr.frC]);
+         if (useAVX) {
+            a.vmulsd(tmpSrcA, a.loadRegisterRead(a.fprps[instr.frA]), srcC);
+         } else {
+            a.mulsd(tmpSrcA, srcC);
+         }
       }
-      a.mulsd(tmpSrcA, tmpSrcC);
       break;
    }
    case FPDiv: {
       auto srcB = a.loadRegisterRead(a.fprps[instr.frB]);
-      a.divsd(tmpSrcA, srcB);
+      if (useAVX) {
+         a.vdivsd(tmpSrcA, a.loadRegisterRead(a.fprps[instr.frA]), srcB);
+      } else {
+         a.divsd(tmpSrcA, srcB);
+      }
       break;
    }
    }
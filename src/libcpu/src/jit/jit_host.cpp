@@ -0,0 +1,120 @@
+#include "cpu.h"
+#include "jit_host.h"
+
+#include <common/log.h>
+#include <common/platform.h>
+#include <cstdint>
+
+#ifdef PLATFORM_WINDOWS
+#include <intrin.h>
+#endif
+
+namespace cpu
+{
+
+namespace jit
+{
+
+struct HostFeatures
+{
+   bool checked = false;
+   bool movbe = false;
+   bool bmi2 = false;
+   bool avx = false;
+};
+
+static bool
+sExtensionsEnabled = true;
+
+static HostFeatures
+sHostFeatures;
+
+static void
+cpuid(uint32_t leaf,
+      uint32_t subleaf,
+      uint32_t regs[4])
+{
+#ifdef PLATFORM_WINDOWS
+   int cpuInfo[4];
+   __cpuidex(cpuInfo, leaf, subleaf);
+
+   for (auto i = 0; i < 4; ++i) {
+      regs[i] = static_cast<uint32_t>(cpuInfo[i]);
+   }
+#else
+   __asm__("cpuid"
+           : "=a" (regs[0]), "=b" (regs[1]), "=c" (regs[2]), "=d" (regs[3])
+           : "0" (leaf), "2" (subleaf));
+#endif
+}
+
+static uint64_t
+xgetbv(uint32_t index)
+{
+#ifdef PLATFORM_WINDOWS
+   return _xgetbv(index);
+#else
+   uint32_t eax, edx;
+   __asm__("xgetbv" : "=a" (eax), "=d" (edx) : "c" (index));
+   return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+
+static const HostFeatures &
+getHostFeatures()
+{
+   if (!sHostFeatures.checked) {
+      uint32_t regs[4];
+      sHostFeatures.checked = true;
+
+      cpuid(0, 0, regs);
+      auto maxLeaf = regs[0];
+
+      cpuid(1, 0, regs);
+      sHostFeatures.movbe = !!(regs[2] & (1 << 22));
+
+      // AVX also needs the OS to save the YMM state for us
+      if ((regs[2] & (1 << 28)) && (regs[2] & (1 << 27))) {
+         sHostFeatures.avx = (xgetbv(0) & 0x6) == 0x6;
+      }
+
+      if (maxLeaf >= 7) {
+         cpuid(7, 0, regs);
+         sHostFeatures.bmi2 = !!(regs[1] & (1 << 8));
+      }
+
+      gLog->info("JIT host extensions: MOVBE {}, BMI2 {}, AVX {}{}",
+                 sHostFeatures.movbe, sHostFeatures.bmi2, sHostFeatures.avx,
+                 sExtensionsEnabled ? "" : " (disabled)");
+   }
+
+   return sHostFeatures;
+}
+
+bool
+hostHasMOVBE()
+{
+   return sExtensionsEnabled && getHostFeatures().movbe;
+}
+
+bool
+hostHasBMI2()
+{
+   return sExtensionsEnabled && getHostFeatures().bmi2;
+}
+
+bool
+hostHasAVX()
+{
+   return sExtensionsEnabled && getHostFeatures().avx;
+}
+
+} // namespace jit
+
+void
+setJitHostExtensions(bool enabled)
+{
+   jit::sExtensionsEnabled = enabled;
+}
+
+} // namespace cpu
@@ -0,0 +1,20 @@
+#pragma once
+
+namespace cpu
+{
+
+namespace jit
+{
+
+bool
+hostHasMOVBE();
+
+bool
+hostHasBMI2();
+
+bool
+hostHasAVX();
+
+} // namespace jit
+
+} // namespace cpu
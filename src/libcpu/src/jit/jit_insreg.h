@@ -25,6 +25,7 @@ void registerPairedInstructions();
 void registerSystemInstructions();
 
 bool jit_fallback(PPCEmuAssembler& a, Instruction instr);
+void initialiseFallbackImports(JitImports &imports);
 
 } // namespace jit
 
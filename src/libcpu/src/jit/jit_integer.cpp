@@ -1,5 +1,6 @@
 #include <cassert>
 #include "jit_insreg.h"
+#include "jit_host.h"
 #include <common/bitutils.h>
 
 using espresso::ConditionRegisterFlag;
@@ -812,11 +813,14 @@ rlwGeneric(PPCEmuAssembler& a, Instruction instr)
    {
       auto tmp = a.allocGpTmp().r32();
 
-      a.mov(tmp, a.loadRegisterRead(a.gpr[instr.rS]));
-
-      if (flags & RlwImmediate) {
+      if ((flags & RlwImmediate) && hostHasBMI2()) {
+         // RORX does not need the source copied first
+         a.rorx(tmp, a.loadRegisterRead(a.gpr[instr.rS]), (32 - instr.sh) & 31);
+      } else if (flags & RlwImmediate) {
+         a.mov(tmp, a.loadRegisterRead(a.gpr[instr.rS]));
          a.rol(tmp, instr.sh);
       } else {
+         a.mov(tmp, a.loadRegisterRead(a.gpr[instr.rS]));
          a.mov(asmjit::x86::ecx, a.loadRegisterRead(a.gpr[instr.rB]));
          a.and_(asmjit::x86::ecx, 0x1f);
          a.rol(tmp, asmjit::x86::cl);
@@ -887,7 +891,7 @@ shiftLogical(PPCEmuAssembler& a, Instruction instr)
    {
       auto tmp = a.allocGpTmp().r64();
 
-      a.mov(tmp, a.loadRegisterRead(a.gpr[instr.rS]));
+      a.mov(tmp.r32(), a.loadRegisterRead(a.gpr[instr.rS]));
 
       if (flags & ShiftImmediate) {
          if (flags & ShiftLeft) {
@@ -897,6 +901,17 @@ shiftLogical(PPCEmuAssembler& a, Instruction instr)
          } else {
             throw;
          }
+      } else if (hostHasBMI2()) {
+         // The 64-bit shifts only use the low 6 bits of rB, like PPC
+         auto shift = a.loadRegisterRead(a.gpr[instr.rB]).r64();
+
+         if (flags & ShiftLeft) {
+            a.shlx(tmp, tmp, shift);
+         } else if (flags & ShiftRight) {
+            a.shrx(tmp, tmp, shift);
+         } else {
+            throw;
+         }
       } else {
          a.mov(asmjit::x86::ecx, a.loadRegisterRead(a.gpr[instr.rB]));
 
@@ -960,6 +975,13 @@ shiftArithmetic(PPCEmuAssembler& a, Instruction instr)
          a.sar(tmp.r64(), instr.sh);
 
          a.shl(tmp2.r64(), 32 - instr.sh);
+      } else if (hostHasBMI2()) {
+         auto shift = a.loadRegisterRead(a.gpr[instr.rB]).r64();
+
+         a.sarx(tmp.r64(), tmp.r64(), shift);
+
+         a.shl(tmp2.r64(), 32);
+         a.shrx(tmp2.r64(), tmp2.r64(), shift);
       } else {
          a.mov(asmjit::x86::ecx, a.loadRegisterRead(a.gpr[instr.rB]));
 
@@ -1,6 +1,8 @@
 #pragma once
 #include <common/decaf_assert.h>
 #include "cpu.h"
+#include "cpu_internal.h"
+#include "espresso/espresso_instructionid.h"
 #include <array>
 #include <asmjit/asmjit.h>
 #include <map>
@@ -15,19 +17,46 @@ namespace cpu
 namespace jit
 {
 
+// 128-bit constant operand for SSE instructions
+struct alignas(16) JitConstant
+{
+   uint64_t lo;
+   uint64_t hi;
+};
+
+enum class JitConstantId : uint32_t
+{
+   FloatSignMask,    // Sign bit of both lanes
+   FloatAbsMask,     // Everything but the sign bit of both lanes
+   Ps0Round24Mask,   // Clear bits below the 24-bit mantissa of the low lane
+   Ps0Round24Bit,    // Rounding bit of the 24-bit mantissa of the low lane
+   Round24Mask,      // Clear bits below the 24-bit mantissa of both lanes
+   Round24Bit,       // Rounding bit of the 24-bit mantissa of both lanes
+   Count
+};
+
 /*
 Register Assignments:
-RAX    . Scratch
-RCX    . Scratch
-RDX    . Scratch
-RDI    . Scratch
-RSI    . Scratch
-RBX    . Core*
-RBP    . mem::base()
-RSP    . Emu Stack Pointer.
-R8-R15 . Scratch
+RAX     . Scratch
+RCX     . Scratch
+RDX     . Scratch
+RDI     . Scratch
+RSI     . Scratch
+RBX     . Core*
+RBP     . mem::base()
+RSP     . Emu Stack Pointer.
+R8-R11  . Scratch
+R12-R15 . Pinned guest registers, see JitPinnedGprs
 */
 
+// Guest GPRs which live in R12-R15 for as long as generated code is
+//  running, including across jumps between blocks.  These are only
+//  written back to Core when calling out of generated code.
+static const std::array<uint32_t, 4> JitPinnedGprs = { { 1, 2, 3, 13 } };
+
+// Host register index of the first pinned register
+static const uint32_t JitPinnedHostRegIndex = 12;
+
 class PPCEmuAssembler : public asmjit::X86Assembler
 {
 private:
@@ -68,6 +97,9 @@ public:
       bool written = false;
       uint32_t size = 0;
       uint32_t content = 0xFFFFFFFF;
+
+      // Permanently holds a guest register, never evicted
+      bool pinned = false;
    };
 
    struct PpcRef {
@@ -115,6 +147,14 @@ public:
       PPCMemRef(niaMem, nia);
       PPCMemRef(coreIdMem, id);
       PPCMemRef(interruptMem, interrupt);
+      PPCMemRef(virtualTimeMem, virtual_time);
+      PPCMemRef(virtualCountdownMem, virtual_countdown);
+      PPCMemRef(hasAlarmMem, has_alarm);
+      PPCMemRef(traceRingMem, traceRing);
+      PPCMemRef(traceIndexMem, traceIndex);
+      PPCMemRef(traceMaskMem, traceMask);
+      PPCMemRef(fpuUsedMem, fpuUsed);
+      PPCMemRef(importsMem, jitImports);
 
 #undef PPCMemRef
 
@@ -171,6 +211,25 @@ public:
       for (auto i = 0; i < mXmmRegVals.size(); ++i) {
          mRegs[regIdx++] = HostRegister(RegType::Xmm, i);
       }
+
+      // The last Gp registers are R12-R15 which hold the pinned registers
+      for (auto i = 0u; i < JitPinnedGprs.size(); ++i) {
+         auto &reg = mRegs[MaxGpRegSlots - JitPinnedGprs.size() + i];
+         decaf_check(mGpRegVals[reg.regId].getRegIndex() == JitPinnedHostRegIndex + i);
+         reg.pinned = true;
+         reg.content = gpr[JitPinnedGprs[i]].offset;
+         reg.size = gpr[JitPinnedGprs[i]].size;
+         reg.loaded = true;
+      }
+   }
+
+   // Generated code must only reference host addresses through the
+   //  JitImports table so that it stays relocatable, this loads the
+   //  table into reg and returns a reference to the entry at offset.
+   asmjit::X86Mem importRef(const asmjit::X86GpReg &reg, size_t offset, uint32_t size = 8)
+   {
+      mov(reg, importsMem);
+      return asmjit::X86Mem(reg, static_cast<int32_t>(offset), size);
    }
 
    void shiftTo(asmjit::X86GpReg reg, int s, int d)
@@ -184,6 +243,7 @@ public:
 
    uint32_t genCia;
    std::vector<std::pair<uint32_t, asmjit::Label>> relocLabels;
+   std::map<uint32_t, asmjit::Label> jumpLabels;
 
    asmjit::X86GpReg sysArgReg[4];
    asmjit::X86GpReg finaleNiaArgReg;
@@ -199,6 +259,21 @@ public:
    asmjit::X86Mem niaMem;
    asmjit::X86Mem coreIdMem;
    asmjit::X86Mem interruptMem;
+   asmjit::X86Mem virtualTimeMem;
+   asmjit::X86Mem virtualCountdownMem;
+   asmjit::X86Mem hasAlarmMem;
+   asmjit::X86Mem traceRingMem;
+   asmjit::X86Mem traceIndexMem;
+   asmjit::X86Mem traceMaskMem;
+   asmjit::X86Mem fpuUsedMem;
+   asmjit::X86Mem importsMem;
+
+   // Guest instructions generated since the last flushRetired
+   uint32_t pendingRetired = 0;
+
+   // Set by reloadPinned, anything which calls out to host code may have
+   //  switched this core to another context.
+   bool calledOut = false;
 
    PpcGpRef gpr[32];
    PpcXmmRef fprps[32];
@@ -444,7 +519,7 @@ public:
       //  least-recently used register at the same time.
       for (auto i = 0; i < mRegs.size(); ++i) {
          auto &reg = mRegs[i];
-         if (reg.regType != regType) {
+         if (reg.regType != regType || reg.pinned) {
             continue;
          }
          if (!reg.useCount) {
@@ -678,7 +753,7 @@ public:
    void saveAll()
    {
       for (auto i = 0; i < mRegs.size(); ++i) {
-         if (mRegs[i].content != 0xFFFFFFFF) {
+         if (mRegs[i].content != 0xFFFFFFFF && !mRegs[i].pinned) {
             saveOne(&mRegs[i]);
          }
       }
@@ -686,6 +761,7 @@ public:
 
    void evictOne(HostRegister *reg)
    {
+      decaf_check(!reg->pinned);
       saveOne(reg);
 
       reg->content = 0xFFFFFFFF;
@@ -697,12 +773,70 @@ public:
    void evictAll()
    {
       for (auto i = 0; i < mRegs.size(); ++i) {
-         if (mRegs[i].content != 0xFFFFFFFF) {
+         if (mRegs[i].content != 0xFFFFFFFF && !mRegs[i].pinned) {
             evictOne(&mRegs[i]);
          }
       }
    }
 
+   // Write the pinned registers back to Core, this must be done before
+   //  calling anything which reads guest registers.  Previous blocks may
+   //  have modified them so they are always stored.
+   void spillPinned()
+   {
+      for (auto &reg : mRegs) {
+         if (reg.pinned) {
+            decaf_check(reg.useCount == 0);
+            mov(asmjit::X86Mem(stateReg, reg.content, 4), mGpRegVals[reg.regId].r32());
+            reg.written = false;
+         }
+      }
+   }
+
+   // Add the instructions generated since the last flush to the virtual
+   //  time base and raise the alarm interrupt once its countdown runs out,
+   //  this mirrors advanceVirtualTime.  Uses no host registers.
+   void flushRetired()
+   {
+      if (!gVirtualTime || !pendingRetired) {
+         pendingRetired = 0;
+         return;
+      }
+
+      auto noAlarm = newLabel();
+      add(virtualTimeMem, pendingRetired);
+
+      // The countdown is stale when no alarm is set, leave it alone
+      cmp(hasAlarmMem, 0);
+      je(noAlarm);
+
+      sub(virtualCountdownMem, pendingRetired);
+      ja(noAlarm);
+
+      mov(hasAlarmMem, 0);
+      mov(virtualCountdownMem, 0);
+      lock().or_(interruptMem, ALARM_INTERRUPT);
+
+      bind(noAlarm);
+      pendingRetired = 0;
+   }
+
+   // Load the pinned registers from Core, this must be done on entry to
+   //  generated code and after calling anything which may modify guest
+   //  registers or switch stateReg to a different core.
+   void reloadPinned()
+   {
+      calledOut = true;
+
+      for (auto &reg : mRegs) {
+         if (reg.pinned) {
+            decaf_check(reg.useCount == 0);
+            mov(mGpRegVals[reg.regId].r32(), asmjit::X86Mem(stateReg, reg.content, 4));
+            reg.written = false;
+         }
+      }
+   }
+
 };
 
 template<typename T, typename Z>
@@ -720,12 +854,41 @@ using JumpLabelMap = std::map<uint32_t, asmjit::Label>;
 extern JitCall gCallFn;
 extern JitFinale gFinaleFn;
 
+// Host functions and data used by generated code, reached through
+//  Core::jitImports rather than by absolute address.
+struct JitImports
+{
+   JitConstant constants[static_cast<size_t>(JitConstantId::Count)];
+   JitFinale finaleFn;
+   void *interruptStub;
+   void *kcStub;
+   uint64_t *fallbackCalls;
+   void *fallbackFn[static_cast<size_t>(espresso::InstructionID::InstructionCount)];
+};
+
+extern JitImports gJitImports;
+
+static inline size_t
+importConstantOffset(JitConstantId id)
+{
+   return offsetof2(JitImports, constants) + sizeof(JitConstant) * static_cast<size_t>(id);
+}
+
+static inline size_t
+importFallbackOffset(espresso::InstructionID id)
+{
+   return offsetof2(JitImports, fallbackFn) + sizeof(void *) * static_cast<size_t>(id);
+}
+
 struct JitBlock
 {
    JitBlock(uint32_t _start) {
       start = _start;
       end = _start;
       entry = nullptr;
+      code = nullptr;
+      codeSize = 0;
+      entryCount = nullptr;
    }
 
    uint32_t start;
@@ -733,6 +896,16 @@ struct JitBlock
 
    JitCode entry;
    std::vector<std::pair<uint32_t, JitCode>> targets;
+
+   uint8_t *code;
+   size_t codeSize;
+   std::vector<std::pair<uint32_t, JitCode *>> relocations;
+
+   // Pairs of host code offset and guest address of each instruction
+   std::vector<std::pair<uint32_t, uint32_t>> addressMap;
+
+   // Number of times the block was entered, when profiling
+   uint64_t *entryCount;
 };
 
 } // namespace jit
@@ -1,4 +1,5 @@
 #include "jit_insreg.h"
+#include "jit_host.h"
 #include <common/bitutils.h>
 #include <common/decaf_assert.h>
 #include <algorithm>
@@ -48,22 +49,30 @@ loadGeneric(PPCEmuAssembler& a, Instruction instr)
 
    auto data = a.allocGpTmp().r64();
 
-   {
-      auto hostSrc = a.allocGpTmp().r64();
-      a.mov(hostSrc, src);
-      a.add(hostSrc, a.membaseReg);
-
-      if (sizeof(Type) == 1) {
-         a.mov(data, 0);
-         a.mov(data.r8(), asmjit::X86Mem(hostSrc, 0));
-      } else if (sizeof(Type) == 2) {
-         a.mov(data, 0);
-         a.mov(data.r16(), asmjit::X86Mem(hostSrc, 0));
+   // src only ever holds a 32-bit value so we can index membase with it
+   //  directly.  MOVBE lets us swap while loading, except for lwarx which
+   //  needs the raw value for the reservation.
+   auto hostSrc = asmjit::X86Mem(a.membaseReg, src.r64(), 0, 0, sizeof(Type));
+   auto swapOnLoad = !(flags & LoadByteReverse) && !(flags & LoadReserve)
+                  && sizeof(Type) > 1 && hostHasMOVBE();
+
+   if (sizeof(Type) == 1) {
+      a.movzx(data.r32(), hostSrc);
+   } else if (swapOnLoad) {
+      if (sizeof(Type) == 2) {
+         a.movbe(data.r16(), hostSrc);
+         a.movzx(data.r32(), data.r16());
       } else if (sizeof(Type) == 4) {
-         a.mov(data.r32(), asmjit::X86Mem(hostSrc, 0));
+         a.movbe(data.r32(), hostSrc);
       } else if (sizeof(Type) == 8) {
-         a.mov(data, asmjit::X86Mem(hostSrc, 0));
+         a.movbe(data, hostSrc);
       }
+   } else if (sizeof(Type) == 2) {
+      a.movzx(data.r32(), hostSrc);
+   } else if (sizeof(Type) == 4) {
+      a.mov(data.r32(), hostSrc);
+   } else if (sizeof(Type) == 8) {
+      a.mov(data, hostSrc);
    }
 
    if (flags & LoadReserve) {
@@ -75,7 +84,7 @@ loadGeneric(PPCEmuAssembler& a, Instruction instr)
       a.or_(ppcreserve, data);
    }
 
-   if (!(flags & LoadByteReverse)) {
+   if (!(flags & LoadByteReverse) && !swapOnLoad) {
       if (sizeof(Type) == 1) {
          // No need to byte-swap 1 byte
       } else if (sizeof(Type) == 2) {
@@ -305,8 +314,13 @@ lmw(PPCEmuAssembler& a, Instruction instr)
 
    for (int r = instr.rD, d = 0; r <= 31; ++r, d += 4) {
       auto dst = a.loadRegisterWrite(a.gpr[r]);
-      a.mov(dst, asmjit::X86Mem(src, d));
-      a.bswap(dst);
+
+      if (hostHasMOVBE()) {
+         a.movbe(dst, asmjit::X86Mem(src, d, 4));
+      } else {
+         a.mov(dst, asmjit::X86Mem(src, d));
+         a.bswap(dst);
+      }
    }
 
    return true;
@@ -380,6 +394,12 @@ storeGeneric(PPCEmuAssembler& a, Instruction instr)
 
    auto data = a.allocGpTmp().r64();
 
+   // MOVBE lets us swap while storing, except for stwcx. which needs the
+   //  swapped value in a register for the compare exchange.
+   auto swapOnStore = !(flags & StoreByteReverse) && !(flags & StoreConditional)
+                   && sizeof(Type) > 1 && hostHasMOVBE();
+   auto storeFromGpr = !(flags & StoreFloatAsInteger) && !std::is_floating_point<Type>::value;
+
    if (flags & StoreFloatAsInteger) {
       decaf_check(sizeof(Type) == 4);
       a.movd(data.r32(), a.loadRegisterRead(a.fprps[instr.rS]));
@@ -392,11 +412,11 @@ storeGeneric(PPCEmuAssembler& a, Instruction instr)
          decaf_check(sizeof(Type) == 8);
          a.movq(data, a.loadRegisterRead(a.fprps[instr.rS]));
       }
-   } else {
+   } else if (!swapOnStore) {
       a.mov(data.r32(), a.loadRegisterRead(a.gpr[instr.rS]));
    }
 
-   if (!(flags & StoreByteReverse)) {
+   if (!(flags & StoreByteReverse) && !swapOnStore) {
       if (sizeof(Type) == 1) {
          // Inverted reverse logic means we have
          //    to check for this but do nothing.
@@ -414,9 +434,7 @@ storeGeneric(PPCEmuAssembler& a, Instruction instr)
    auto failedWriteLbl = a.newLabel();
 
    {
-      auto hostDst = a.allocGpTmp().r64();
-      a.mov(hostDst, dst);
-      a.add(hostDst, a.membaseReg);
+      auto hostDst = asmjit::X86Mem(a.membaseReg, dst.r64(), 0, 0, sizeof(Type));
 
       if (flags & StoreConditional) {
          static_assert(!(flags & StoreConditional) || sizeof(Type) == 4, "Reserved writes are only valid on 32-bit values");
@@ -448,19 +466,34 @@ storeGeneric(PPCEmuAssembler& a, Instruction instr)
          a.mov(ppcreserve, 0xffffffffffffffff);
          a.jne(failedWriteLbl);
 
-         a.lock().cmpxchg(asmjit::X86Mem(hostDst, 0), data.r32());
+         a.lock().cmpxchg(hostDst, data.r32());
          a.jne(failedWriteLbl);
 
          a.or_(ppccr, ConditionRegisterFlag::Equal << crshift);
+      } else if (swapOnStore) {
+         // Integer stores can go straight from the guest register
+         auto src = asmjit::X86GpReg { data };
+
+         if (storeFromGpr) {
+            src = a.loadRegisterRead(a.gpr[instr.rS]);
+         }
+
+         if (sizeof(Type) == 2) {
+            a.movbe(hostDst, src.r16());
+         } else if (sizeof(Type) == 4) {
+            a.movbe(hostDst, src.r32());
+         } else if (sizeof(Type) == 8) {
+            a.movbe(hostDst, src.r64());
+         }
       } else {
          if (sizeof(Type) == 1) {
-            a.mov(asmjit::X86Mem(hostDst, 0), data.r8());
+            a.mov(hostDst, data.r8());
          } else if (sizeof(Type) == 2) {
-            a.mov(asmjit::X86Mem(hostDst, 0), data.r16());
+            a.mov(hostDst, data.r16());
          } else if (sizeof(Type) == 4) {
-            a.mov(asmjit::X86Mem(hostDst, 0), data.r32());
+            a.mov(hostDst, data.r32());
          } else if (sizeof(Type) == 8) {
-            a.mov(asmjit::X86Mem(hostDst, 0), data);
+            a.mov(hostDst, data);
          }
       }
    }
@@ -639,6 +672,14 @@ stmw(PPCEmuAssembler& a, Instruction instr)
 
    a.add(dst, a.membaseReg);
 
+   if (hostHasMOVBE()) {
+      for (int r = instr.rS, d = 0; r <= 31; ++r, d += 4) {
+         a.movbe(asmjit::X86Mem(dst, d, 4), a.loadRegisterRead(a.gpr[r]));
+      }
+
+      return true;
+   }
+
    auto src = a.allocGpTmp().r32();
    for (int r = instr.rS, d = 0; r <= 31; ++r, d += 4) {
       a.mov(src, a.loadRegisterRead(a.gpr[r]));
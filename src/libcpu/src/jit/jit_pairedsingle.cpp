@@ -1,6 +1,7 @@
 #include "jit_insreg.h"
 #include "jit_float.h"
 #include <common/bitutils.h>
+#include <cstdint>
 
 namespace cpu
 {
@@ -8,6 +9,531 @@ namespace cpu
 namespace jit
 {
 
+// Both paired-single slots live in a single XMM register, with ps0 in
+//  the low lane and ps1 in the high lane, so most instructions below
+//  operate on the two lanes at once with packed SSE instructions.
+static asmjit::X86Mem
+packedConstant(PPCEmuAssembler& a,
+               const PPCEmuAssembler::GpRegister& tmp,
+               JitConstantId id)
+{
+   return a.importRef(tmp, importConstantOffset(id), 16);
+}
+
+static void
+roundToSinglePd(PPCEmuAssembler& a,
+                const PPCEmuAssembler::XmmRegister& dst,
+                const PPCEmuAssembler::XmmRegister& src)
+{
+   a.cvtpd2ps(dst, src);
+   a.cvtps2pd(dst, dst);
+}
+
+// Truncate the low lane of src to single precision exactly as
+//  truncate_double followed by extend_float does in the interpreter: tiny
+//  values flush to zero, values below the single range keep only the bits
+//  a single denormal can hold and values above it become infinity.
+//  Nothing is allocated between the labels, so every path leaves the
+//  register allocator in the same state.
+static void
+truncateToSingleExact(PPCEmuAssembler& a,
+                      const PPCEmuAssembler::XmmRegister& dst,
+                      const PPCEmuAssembler::XmmRegister& src)
+{
+   auto bits = a.allocGpTmp();
+   auto tmp = a.allocGpTmp();
+   auto mask = a.allocXmmTmp();
+   auto count = a.allocXmmTmp();
+   auto inRange = a.newLabel();
+   auto flushZero = a.newLabel();
+   auto overflow = a.newLabel();
+   auto done = a.newLabel();
+
+   a.movq(bits, src);
+   a.movapd(dst, src);
+   a.mov(tmp, bits);
+   a.shr(tmp, 52);
+   a.and_(tmp, 0x7FF);
+
+   // NaN and infinity truncate the same way as normal values
+   a.cmp(tmp, 2047);
+   a.je(inRange);
+   a.cmp(tmp, 1151);
+   a.jae(overflow);
+   a.cmp(tmp, 897);
+   a.jae(inRange);
+   a.cmp(tmp, 873);
+   a.jbe(flushZero);
+
+   // Single denormal, keep the top exponent - 874 bits of the mantissa
+   a.neg(tmp);
+   a.add(tmp, 926);
+   a.movq(count, tmp);
+   a.pcmpeqd(mask, mask);
+   a.psllq(mask, count);
+   a.pand(dst, mask);
+   a.jmp(done);
+
+   a.bind(flushZero);
+   a.mov(tmp, UINT64_C(0x8000000000000000));
+   a.and_(bits, tmp);
+   a.movq(dst, bits);
+   a.jmp(done);
+
+   a.bind(overflow);
+   a.mov(tmp, UINT64_C(0x8000000000000000));
+   a.and_(bits, tmp);
+   a.mov(tmp, UINT64_C(0x7FF0000000000000));
+   a.or_(bits, tmp);
+   a.movq(dst, bits);
+   a.jmp(done);
+
+   a.bind(inRange);
+   a.mov(tmp, UINT64_C(0xFFFFFFFFE0000000));
+   a.movq(mask, tmp);
+   a.pand(dst, mask);
+
+   a.bind(done);
+}
+
+// Round the low lane of src to single precision like roundToSingleSd, except
+//  a signalling NaN is truncated rather than quieted as the interpreter's
+//  register moves do.
+static void
+roundToSingleKeepSNaN(PPCEmuAssembler& a,
+                      const PPCEmuAssembler::XmmRegister& dst,
+                      const PPCEmuAssembler::XmmRegister& src)
+{
+   auto bits = a.allocGpTmp();
+   auto tmp = a.allocGpTmp();
+   auto round = a.newLabel();
+   auto done = a.newLabel();
+
+   a.movq(bits, src);
+
+   // Quiet bit set, or not a NaN at all
+   a.bt(bits, 51);
+   a.jc(round);
+   a.mov(tmp, bits);
+   a.shr(tmp, 52);
+   a.and_(tmp, 0x7FF);
+   a.cmp(tmp, 2047);
+   a.jne(round);
+   a.mov(tmp, bits);
+   a.shl(tmp, 12);
+   a.jz(round);
+
+   a.mov(tmp, UINT64_C(0xFFFFFFFFE0000000));
+   a.and_(bits, tmp);
+   a.movq(dst, bits);
+   a.jmp(done);
+
+   a.bind(round);
+   roundToSingleSd(a, dst, src);
+
+   a.bind(done);
+}
+
+// PPC rounds the multiplier to 24 bits of mantissa when it came from
+//  ps0 of frC, but not when it came from ps1.
+static void
+roundTo24BitPd(PPCEmuAssembler& a,
+               const PPCEmuAssembler::XmmRegister& reg,
+               bool roundPs1)
+{
+   auto tmpGp = a.allocGpTmp();
+   auto tmp = a.allocXmmTmp(reg);
+
+   a.pand(tmp, packedConstant(a, tmpGp, roundPs1 ? JitConstantId::Round24Bit : JitConstantId::Ps0Round24Bit));
+   a.pand(reg, packedConstant(a, tmpGp, roundPs1 ? JitConstantId::Round24Mask : JitConstantId::Ps0Round24Mask));
+   a.paddq(reg, tmp);
+}
+
+// Copy frC into dst with the given slots in each lane.
+template<int slot0, int slot1>
+static void
+selectSlots(PPCEmuAssembler& a,
+            const PPCEmuAssembler::XmmRegister& dst,
+            const PPCEmuAssembler::XmmRegister& src)
+{
+   static_assert((slot0 == 0 && slot1 == 1) || slot0 == slot1, "Unsupported slot selection");
+
+   if (slot0 == 0 && slot1 == 1) {
+      a.movapd(dst, src);
+   } else if (slot0 == 0) {
+      a.movddup(dst, src);
+   } else {
+      a.movapd(dst, src);
+      a.unpckhpd(dst, dst);
+   }
+}
+
+// Register move / sign bit manipulation
+enum MoveMode
+{
+   MoveDirect,
+   MoveNegate,
+   MoveAbsolute,
+   MoveNegAbsolute,
+};
+
+template<MoveMode mode>
+static bool
+moveGeneric(PPCEmuAssembler& a, Instruction instr)
+{
+   if (instr.rc) {
+      return jit_fallback(a, instr);
+   }
+
+   auto result = a.allocXmmTmp();
+   {
+      auto srcB = a.loadRegisterRead(a.fprps[instr.frB]);
+
+      // ps1 is always truncated
+      auto ps1 = a.allocXmmTmp(srcB);
+      a.unpckhpd(ps1, ps1);
+      truncateToSingleExact(a, ps1, ps1);
+
+      // ps0 is rounded to single precision, unless it is a signalling NaN
+      roundToSingleKeepSNaN(a, result, srcB);
+      a.unpcklpd(result, ps1);
+   }
+
+   if (mode != MoveDirect) {
+      auto tmpGp = a.allocGpTmp();
+
+      switch (mode) {
+      case MoveNegate:
+         a.pxor(result, packedConstant(a, tmpGp, JitConstantId::FloatSignMask));
+         break;
+      case MoveAbsolute:
+         a.pand(result, packedConstant(a, tmpGp, JitConstantId::FloatAbsMask));
+         break;
+      case MoveNegAbsolute:
+         a.por(result, packedConstant(a, tmpGp, JitConstantId::FloatSignMask));
+         break;
+      default:
+         break;
+      }
+   }
+
+   auto dst = a.loadRegisterWrite(a.fprps[instr.frD]);
+   a.movapd(dst, result);
+   return true;
+}
+
+static bool
+ps_mr(PPCEmuAssembler& a, Instruction instr)
+{
+   return moveGeneric<MoveDirect>(a, instr);
+}
+
+static bool
+ps_neg(PPCEmuAssembler& a, Instruction instr)
+{
+   return moveGeneric<MoveNegate>(a, instr);
+}
+
+static bool
+ps_abs(PPCEmuAssembler& a, Instruction instr)
+{
+   return moveGeneric<MoveAbsolute>(a, instr);
+}
+
+static bool
+ps_nabs(PPCEmuAssembler& a, Instruction instr)
+{
+   return moveGeneric<MoveNegAbsolute>(a, instr);
+}
+
+// Paired-single arithmetic
+enum PSArithOperator {
+   PSAdd,
+   PSSub,
+   PSMul,
+   PSDiv,
+};
+
+template<PSArithOperator op, int slotC0, int slotC1>
+static bool
+psArithGeneric(PPCEmuAssembler& a, Instruction instr)
+{
+   if (instr.rc) {
+      return jit_fallback(a, instr);
+   }
+
+   // FPSCR, FPRF supposed to be updated here...
+
+   auto result = a.allocXmmTmp(a.loadRegisterRead(a.fprps[instr.frA]));
+
+   switch (op) {
+   case PSAdd: {
+      auto srcB = a.loadRegisterRead(a.fprps[instr.frB]);
+      a.addpd(result, srcB);
+      break;
+   }
+   case PSSub: {
+      auto srcB = a.loadRegisterRead(a.fprps[instr.frB]);
+      a.subpd(result, srcB);
+      break;
+   }
+   case PSMul: {
+      auto tmpSrcC = a.allocXmmTmp();
+      {
+         auto srcC = a.loadRegisterRead(a.fprps[instr.frC]);
+         selectSlots<slotC0, slotC1>(a, tmpSrcC, srcC);
+      }
+
+      if (slotC0 == 0) {
+         roundTo24BitPd(a, tmpSrcC, slotC1 == 0);
+      }
+
+      a.mulpd(result, tmpSrcC);
+      break;
+   }
+   case PSDiv: {
+      auto srcB = a.loadRegisterRead(a.fprps[instr.frB]);
+      a.divpd(result, srcB);
+      break;
+   }
+   }
+
+   roundToSinglePd(a, result, result);
+
+   auto dst = a.loadRegisterWrite(a.fprps[instr.frD]);
+   a.movapd(dst, result);
+   return true;
+}
+
+static bool
+ps_add(PPCEmuAssembler& a, Instruction instr)
+{
+   return psArithGeneric<PSAdd, 0, 1>(a, instr);
+}
+
+static bool
+ps_sub(PPCEmuAssembler& a, Instruction instr)
+{
+   return psArithGeneric<PSSub, 0, 1>(a, instr);
+}
+
+static bool
+ps_mul(PPCEmuAssembler& a, Instruction instr)
+{
+   return psArithGeneric<PSMul, 0, 1>(a, instr);
+}
+
+static bool
+ps_muls0(PPCEmuAssembler& a, Instruction instr)
+{
+   return psArithGeneric<PSMul, 0, 0>(a, instr);
+}
+
+static bool
+ps_muls1(PPCEmuAssembler& a, Instruction instr)
+{
+   return psArithGeneric<PSMul, 1, 1>(a, instr);
+}
+
+static bool
+ps_div(PPCEmuAssembler& a, Instruction instr)
+{
+   return psArithGeneric<PSDiv, 0, 1>(a, instr);
+}
+
+template<int slot>
+static bool
+psSumGeneric(PPCEmuAssembler& a, Instruction instr)
+{
+   if (instr.rc) {
+      return jit_fallback(a, instr);
+   }
+
+   // FPSCR, FPRF supposed to be updated here...
+
+   auto result = a.allocXmmTmp();
+
+   if (slot == 0) {
+      // ps1 is copied from frC unmodified
+      a.movapd(result, a.loadRegisterRead(a.fprps[instr.frC]));
+   } else {
+      // ps0 is frC(ps0) rounded to single precision
+      roundToSingleSd(a, result, a.loadRegisterRead(a.fprps[instr.frC]));
+   }
+
+   {
+      auto sum = a.allocXmmTmp(a.loadRegisterRead(a.fprps[instr.frA]));
+      auto tmpSrcB = a.allocXmmTmp(a.loadRegisterRead(a.fprps[instr.frB]));
+      a.unpckhpd(tmpSrcB, tmpSrcB);
+      a.addsd(sum, tmpSrcB);
+      roundToSingleSd(a, sum, sum);
+
+      if (slot == 0) {
+         a.movsd(result, sum);
+      } else {
+         a.unpcklpd(result, sum);
+      }
+   }
+
+   auto dst = a.loadRegisterWrite(a.fprps[instr.frD]);
+   a.movapd(dst, result);
+   return true;
+}
+
+static bool
+ps_sum0(PPCEmuAssembler& a, Instruction instr)
+{
+   return psSumGeneric<0>(a, instr);
+}
+
+static bool
+ps_sum1(PPCEmuAssembler& a, Instruction instr)
+{
+   return psSumGeneric<1>(a, instr);
+}
+
+// Fused multiply-add instructions
+enum FMAFlags
+{
+   FMASubtract   = 1 << 0, // Subtract instead of add
+   FMANegate     = 1 << 1, // Negate result
+};
+
+// Jump to slowPath unless rounding the double in bits to single gives the
+//  same result as the interpreter.  NaNs, results below the normal single
+//  range and results exactly halfway between two singles, where rounding
+//  twice differs from rounding once, are left to the interpreter.  Clobbers
+//  bits, and allocates nothing so it can be used between labels.
+static void
+checkFmaLane(PPCEmuAssembler& a,
+             const PPCEmuAssembler::GpRegister& bits,
+             const PPCEmuAssembler::GpRegister& tmp,
+             const asmjit::Label& slowPath)
+{
+   a.mov(tmp, bits);
+   a.and_(tmp, 0x1FFFFFFF);
+   a.cmp(tmp, 0x10000000);
+   a.je(slowPath);
+
+   // Without the sign, anything above infinity is a NaN
+   a.shl(bits, 1);
+   a.mov(tmp, UINT64_C(0xFFE0000000000000));
+   a.cmp(bits, tmp);
+   a.ja(slowPath);
+
+   // Nonzero and below an exponent of 897, the smallest normal single
+   a.sub(bits, 1);
+   a.mov(tmp, (UINT64_C(897) << 53) - 1);
+   a.cmp(bits, tmp);
+   a.jb(slowPath);
+}
+
+template<unsigned flags, int slotC0, int slotC1>
+static bool
+fmaGeneric(PPCEmuAssembler& a, Instruction instr)
+{
+   // Without FMA3 we can not get the unrounded product, and we can not
+   //  match the interpreter's rounding from mulpd + addpd.
+   if (instr.rc || !hostHasFMA3()) {
+      return jit_fallback(a, instr);
+   }
+
+   // FPSCR, FPRF supposed to be updated here...
+
+   // Both paths below must leave the register cache in the same state, so
+   //  everything is evicted and the operands are read straight from Core.
+   a.evictAll();
+   a.flushRetired();
+
+   auto slowPath = a.newLabel();
+   auto done = a.newLabel();
+
+   {
+      auto result = a.allocXmmTmp();
+      auto srcB = a.allocXmmTmp();
+      auto tmpSrcC = a.allocXmmTmp();
+      auto bits = a.allocGpTmp();
+      auto tmp = a.allocGpTmp();
+
+      a.movapd(tmpSrcC, asmjit::X86Mem(a.stateReg, a.fprps[instr.frC].offset, 16));
+      selectSlots<slotC0, slotC1>(a, tmpSrcC, tmpSrcC);
+
+      if (slotC0 == 0) {
+         roundTo24BitPd(a, tmpSrcC, slotC1 == 0);
+      }
+
+      a.movapd(result, asmjit::X86Mem(a.stateReg, a.fprps[instr.frA].offset, 16));
+      a.movapd(srcB, asmjit::X86Mem(a.stateReg, a.fprps[instr.frB].offset, 16));
+
+      if (flags & FMASubtract) {
+         a.vfmsub132pd(result, srcB, tmpSrcC);
+      } else {
+         a.vfmadd132pd(result, srcB, tmpSrcC);
+      }
+
+      a.movq(bits, result);
+      checkFmaLane(a, bits, tmp, slowPath);
+
+      a.movapd(srcB, result);
+      a.unpckhpd(srcB, srcB);
+      a.movq(bits, srcB);
+      checkFmaLane(a, bits, tmp, slowPath);
+
+      roundToSinglePd(a, result, result);
+
+      // Safe as neither lane is a NaN
+      if (flags & FMANegate) {
+         a.pxor(result, packedConstant(a, tmp, JitConstantId::FloatSignMask));
+      }
+
+      a.movapd(asmjit::X86Mem(a.stateReg, a.fprps[instr.frD].offset, 16), result);
+   }
+
+   a.jmp(done);
+
+   a.bind(slowPath);
+   jit_fallback(a, instr);
+
+   a.bind(done);
+   return true;
+}
+
+static bool
+ps_madd(PPCEmuAssembler& a, Instruction instr)
+{
+   return fmaGeneric<0, 0, 1>(a, instr);
+}
+
+static bool
+ps_madds0(PPCEmuAssembler& a, Instruction instr)
+{
+   return fmaGeneric<0, 0, 0>(a, instr);
+}
+
+static bool
+ps_madds1(PPCEmuAssembler& a, Instruction instr)
+{
+   return fmaGeneric<0, 1, 1>(a, instr);
+}
+
+static bool
+ps_msub(PPCEmuAssembler& a, Instruction instr)
+{
+   return fmaGeneric<FMASubtract, 0, 1>(a, instr);
+}
+
+static bool
+ps_nmadd(PPCEmuAssembler& a, Instruction instr)
+{
+   return fmaGeneric<FMANegate, 0, 1>(a, instr);
+}
+
+static bool
+ps_nmsub(PPCEmuAssembler& a, Instruction instr)
+{
+   return fmaGeneric<FMANegate | FMASubtract, 0, 1>(a, instr);
+}
+
 // Merge registers
 enum MergeFlags
 {
@@ -75,33 +601,69 @@ ps_merge10(PPCEmuAssembler& a, Instruction instr)
    return mergeGeneric<MergeValue0>(a, instr);
 }
 
+// Select
+static bool
+ps_sel(PPCEmuAssembler& a, Instruction instr)
+{
+   if (instr.rc) {
+      return jit_fallback(a, instr);
+   }
+
+   auto result = a.allocXmmTmp();
+   {
+      auto srcB = a.loadRegisterRead(a.fprps[instr.frB]);
+      auto srcC = a.loadRegisterRead(a.fprps[instr.frC]);
+
+      // mask = !(0 <= frA), so each lane selects frB for negative or NaN
+      //  inputs and frC otherwise
+      auto mask = a.allocXmmTmp();
+      a.pxor(mask, mask);
+
+      constexpr auto NLE_US = 6;
+      a.cmppd(mask, a.loadRegisterRead(a.fprps[instr.frA]), NLE_US);
+
+      a.movapd(result, mask);
+      a.pand(mask, srcB);
+      a.pandn(result, srcC);
+      a.por(result, mask);
+   }
+
+   auto dst = a.loadRegisterWrite(a.fprps[instr.frD]);
+   a.movapd(dst, result);
+   return true;
+}
+
 void registerPairedInstructions()
 {
-   RegisterInstructionFallback(ps_add);
-   RegisterInstructionFallback(ps_div);
-   RegisterInstructionFallback(ps_mul);
-   RegisterInstructionFallback(ps_sub);
-   RegisterInstructionFallback(ps_abs);
-   RegisterInstructionFallback(ps_nabs);
-   RegisterInstructionFallback(ps_neg);
-   RegisterInstructionFallback(ps_sel);
-   RegisterInstructionFallback(ps_res);
-   RegisterInstructionFallback(ps_rsqrte);
-   RegisterInstructionFallback(ps_msub);
-   RegisterInstructionFallback(ps_madd);
-   RegisterInstructionFallback(ps_nmsub);
-   RegisterInstructionFallback(ps_nmadd);
-   RegisterInstructionFallback(ps_mr);
-   RegisterInstructionFallback(ps_sum0);
-   RegisterInstructionFallback(ps_sum1);
-   RegisterInstructionFallback(ps_muls0);
-   RegisterInstructionFallback(ps_muls1);
-   RegisterInstructionFallback(ps_madds0);
-   RegisterInstructionFallback(ps_madds1);
+   RegisterInstruction(ps_add);
+   RegisterInstruction(ps_div);
+   RegisterInstruction(ps_mul);
+   RegisterInstruction(ps_sub);
+   RegisterInstruction(ps_abs);
+   RegisterInstruction(ps_nabs);
+   RegisterInstruction(ps_neg);
+   RegisterInstruction(ps_sel);
+   RegisterInstruction(ps_msub);
+   RegisterInstruction(ps_madd);
+   RegisterInstruction(ps_nmsub);
+   RegisterInstruction(ps_nmadd);
+   RegisterInstruction(ps_mr);
+   RegisterInstruction(ps_sum0);
+   RegisterInstruction(ps_sum1);
+   RegisterInstruction(ps_muls0);
+   RegisterInstruction(ps_muls1);
+   RegisterInstruction(ps_madds0);
+   RegisterInstruction(ps_madds1);
    RegisterInstruction(ps_merge00);
    RegisterInstruction(ps_merge01);
    RegisterInstruction(ps_merge10);
    RegisterInstruction(ps_merge11);
+
+   // The reciprocal estimates use the Espresso lookup tables, which
+   //  rcpps/rsqrtps cannot reproduce bit-exactly, so leave these to
+   //  the interpreter like fres/frsqrte.
+   RegisterInstructionFallback(ps_res);
+   RegisterInstructionFallback(ps_rsqrte);
 }
 
 } // namespace jit
@@ -0,0 +1,131 @@
+#include "cpu.h"
+#include "jit.h"
+#include "jit_profile.h"
+
+#include <common/log.h>
+#include <common/platform.h>
+#include <cstdio>
+#include <mutex>
+#include <spdlog/fmt/fmt.h>
+
+#ifdef PLATFORM_POSIX
+#include <unistd.h>
+#endif
+
+namespace cpu
+{
+
+namespace jit
+{
+
+static bool
+sProfilingEnabled = false;
+
+static std::mutex
+sPerfMapMutex;
+
+static std::FILE *
+sPerfMap = nullptr;
+
+static SymbolNameHandler
+sSymbolNameHandler = nullptr;
+
+bool
+isProfilingEnabled()
+{
+   return sProfilingEnabled;
+}
+
+bool
+isPerfMapEnabled()
+{
+   return sPerfMap != nullptr;
+}
+
+// Writes a line in the format perf expects for JIT code, see
+//  tools/perf/Documentation/jit-interface.txt in the Linux sources.
+void
+writePerfMapEntry(const void *code,
+                  size_t size,
+                  const std::string &name)
+{
+   std::unique_lock<std::mutex> lock { sPerfMapMutex };
+
+   if (!sPerfMap) {
+      return;
+   }
+
+   auto line = fmt::format("{:x} {:x} {}\n", reinterpret_cast<uintptr_t>(code), size, name);
+   std::fwrite(line.data(), 1, line.size(), sPerfMap);
+   std::fflush(sPerfMap);
+}
+
+void
+writePerfMapEntry(const void *code,
+                  size_t size,
+                  uint32_t address)
+{
+   if (!sPerfMap) {
+      return;
+   }
+
+   if (sSymbolNameHandler) {
+      writePerfMapEntry(code, size, fmt::format("ppc_{:08x} {}", address, sSymbolNameHandler(address)));
+   } else {
+      writePerfMapEntry(code, size, fmt::format("ppc_{:08x}", address));
+   }
+}
+
+} // namespace jit
+
+void
+setSymbolNameHandler(SymbolNameHandler handler)
+{
+   jit::sSymbolNameHandler = handler;
+}
+
+void
+setJitProfiling(bool enabled)
+{
+   jit::sProfilingEnabled = enabled;
+}
+
+std::vector<JitBlockProfile>
+getJitProfile()
+{
+   return jit::getProfile();
+}
+
+void
+resetJitProfile()
+{
+   jit::resetProfile();
+}
+
+void
+setJitPerfMap(bool enabled)
+{
+   std::unique_lock<std::mutex> lock { jit::sPerfMapMutex };
+
+   if (jit::sPerfMap) {
+      std::fclose(jit::sPerfMap);
+      jit::sPerfMap = nullptr;
+   }
+
+   if (!enabled) {
+      return;
+   }
+
+#ifdef PLATFORM_POSIX
+   auto path = fmt::format("/tmp/perf-{}.map", getpid());
+   jit::sPerfMap = std::fopen(path.c_str(), "w");
+
+   if (!jit::sPerfMap) {
+      gLog->error("Failed to open JIT perf map {}", path);
+   }
+#else
+   gLog->warn("JIT perf map is not supported on this platform");
+#endif
+}
+
+} // namespace cpu
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace cpu
+{
+
+namespace jit
+{
+
+bool
+isProfilingEnabled();
+
+bool
+isPerfMapEnabled();
+
+void
+writePerfMapEntry(const void *code,
+                  size_t size,
+                  const std::string &name);
+
+void
+writePerfMapEntry(const void *code,
+                  size_t size,
+                  uint32_t address);
+
+} // namespace jit
+
+} // namespace cpu
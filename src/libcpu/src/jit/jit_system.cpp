@@ -13,13 +13,6 @@ namespace cpu
 namespace jit
 {
 
-// Instruction Cache Block Invalidate
-static bool
-icbi(PPCEmuAssembler& a, Instruction instr)
-{
-   return true;
-}
-
 // Data Cache Block Flush
 static bool
 dcbf(PPCEmuAssembler& a, Instruction instr)
@@ -211,10 +204,11 @@ mtspr(PPCEmuAssembler& a, Instruction instr)
 }
 
 static Core *
-kc_stub(cpu::KernelCallFunction func, void *userData)
+kc_stub(uint32_t id)
 {
    auto core = cpu::this_core::state();
-   func(core, userData);
+   auto kc = cpu::getKernelCall(id);
+   kc->func(core, kc->user_data);
    // We grab new core since it may have changed while executing!
    return cpu::this_core::state();
 }
@@ -229,15 +223,18 @@ kc(PPCEmuAssembler& a, Instruction instr)
 
    // Evict all stored register as a KC might read or modify them.
    a.evictAll();
+   a.flushRetired();
 
    // Save NIA back to memory in case KC reads/writes it
    a.mov(a.niaMem, a.genCia + 4);
 
-   // Call the KC
-   a.mov(a.sysArgReg[0], asmjit::Ptr(kc->func));
-   a.mov(a.sysArgReg[1], asmjit::Ptr(kc->user_data));
-   a.call(asmjit::Ptr(&kc_stub));
+   // Call the KC, it may switch us to a different core so the pinned
+   //  registers must be reloaded from whatever Core we come back with.
+   a.spillPinned();
+   a.mov(a.sysArgReg[0].r32(), id);
+   a.call(a.importRef(asmjit::x86::rax, offsetof2(JitImports, kcStub)));
    a.mov(a.stateReg, asmjit::x86::rax);
+   a.reloadPinned();
 
    // Check if the KC adjusted nia.  If it has, we need to return
    //  to the dispatcher.  Note that we assume the cache was already
@@ -249,7 +246,7 @@ kc(PPCEmuAssembler& a, Instruction instr)
 
    a.mov(a.finaleNiaArgReg, a.niaMem);
    a.mov(a.finaleJmpSrcArgReg, 0);
-   a.jmp(asmjit::Ptr(gFinaleFn));
+   a.jmp(a.importRef(asmjit::x86::rax, offsetof2(JitImports, finaleFn)));
 
    a.bind(niaUnchangedLbl);
 
@@ -259,6 +256,8 @@ kc(PPCEmuAssembler& a, Instruction instr)
 void
 registerSystemInstructions()
 {
+   gJitImports.kcStub = reinterpret_cast<void *>(&kc_stub);
+
    RegisterInstruction(dcbf);
    RegisterInstruction(dcbi);
    RegisterInstruction(dcbst);
@@ -267,7 +266,7 @@ registerSystemInstructions()
    RegisterInstruction(dcbz);
    RegisterInstruction(dcbz_l);
    RegisterInstruction(eieio);
-   RegisterInstruction(icbi);
+   RegisterInstructionFallback(icbi);
    RegisterInstruction(isync);
    RegisterInstruction(sync);
    RegisterInstruction(mfspr);
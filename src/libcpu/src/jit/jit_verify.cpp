@@ -27,6 +27,7 @@ insertVerifyCall(PPCEmuAssembler &a,
                  void *verifyWrapper)
 {
    a.saveAll();
+   a.spillPinned();
    a.mov(asmjit::X86Mem(asmjit::x86::rsp, 32, 4), a.genCia);
    a.mov(asmjit::X86Mem(asmjit::x86::rsp, 36, 4), instr);
    a.call(asmjit::Ptr(verifyWrapper));
@@ -77,7 +77,7 @@ getStateFieldName(TraceFieldType type)
    } else if (type >= StateField::FPR0 && type <= StateField::FPR31) {
       return fmt::format("f{:02}", type - StateField::FPR);
    } else if (type >= StateField::GQR0 && type <= StateField::GQR7) {
-      return fmt::format("q{:02}", type - StateField::FPR);
+      return fmt::format("q{:02}", type - StateField::GQR);
    } else if (type == StateField::CR) {
       return "CR";
    } else if (type == StateField::XER) {
@@ -329,6 +329,50 @@ restoreStateField(cpu::CoreRegs *state, TraceFieldType type, const TraceFieldVal
    }
 }
 
+size_t
+getTraceWriteFields(Instruction instr,
+                    InstructionInfo *data,
+                    TraceFieldType *fields,
+                    size_t maxFields,
+                    bool *truncated)
+{
+   auto count = size_t { 0 };
+
+   auto pushField = [&](InstructionField field) {
+      auto stateField = getFieldStateField(instr, field);
+
+      if (stateField == StateField::Invalid) {
+         return;
+      }
+
+      for (auto i = 0u; i < count; ++i) {
+         if (fields[i] == stateField) {
+            return;
+         }
+      }
+
+      if (count == maxFields) {
+         if (truncated) {
+            *truncated = true;
+         }
+
+         return;
+      }
+
+      fields[count++] = stateField;
+   };
+
+   for (auto field : data->write) {
+      pushField(field);
+   }
+
+   for (auto field : data->flags) {
+      pushField(field);
+   }
+
+   return count;
+}
+
 template<typename T>
 static void
 pushUniqueField(std::vector<T> &fields, uint32_t fieldId)
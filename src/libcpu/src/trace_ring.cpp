@@ -0,0 +1,117 @@
+#include "cpu.h"
+#include "cpu_internal.h"
+#include "trace.h"
+#include "trace_ring.h"
+
+#include <algorithm>
+#include <common/log.h>
+#include <fstream>
+
+namespace cpu
+{
+
+static bool
+sJitTraceRing = false;
+
+void
+setJitTraceRing(bool enabled)
+{
+   sJitTraceRing = enabled;
+}
+
+bool
+isJitTraceRingEnabled()
+{
+   return sJitTraceRing && gCore[0].traceRing;
+}
+
+void
+setTraceRingSize(size_t records)
+{
+   auto size = size_t { 0 };
+
+   if (records) {
+      size = 1;
+
+      while (size < records) {
+         size <<= 1;
+      }
+   }
+
+   for (auto &core : gCore) {
+      delete[] core.traceRing;
+      core.traceRing = size ? new TraceRecord[size]() : nullptr;
+      core.traceIndex = 0;
+      core.traceMask = size ? size - 1 : 0;
+   }
+}
+
+void
+writeTraceRecord(Core *core,
+                 uint32_t cia,
+                 espresso::Instruction instr,
+                 espresso::InstructionInfo *data,
+                 bool afterExecute)
+{
+   auto &record = core->traceRing[core->traceIndex & core->traceMask];
+   TraceFieldType fields[TraceRecordMaxFields];
+   auto truncated = false;
+   auto numFields = afterExecute ? getTraceWriteFields(instr, data, fields, TraceRecordMaxFields, &truncated) : 0;
+   core->traceIndex++;
+
+   record.cia = cia;
+   record.instr = instr.value;
+   record.flags = truncated ? TraceRecordTruncated : 0;
+
+   for (auto i = 0u; i < TraceRecordMaxFields; ++i) {
+      if (i < numFields) {
+         TraceFieldValue value;
+         saveStateField(core, fields[i], value);
+         record.fields[i] = static_cast<uint8_t>(fields[i]);
+         record.values[i] = value.u64v0;
+      } else {
+         record.fields[i] = StateField::Invalid;
+         record.values[i] = 0;
+      }
+   }
+}
+
+bool
+saveTraceRing(uint32_t coreId,
+              const std::string &path)
+{
+   auto &core = gCore[coreId];
+
+   if (!core.traceRing) {
+      return false;
+   }
+
+   auto file = std::ofstream { path, std::ofstream::out | std::ofstream::binary };
+
+   if (!file.is_open()) {
+      gLog->error("Could not open {} to save trace ring", path);
+      return false;
+   }
+
+   auto header = TraceRingHeader { };
+   header.magic = TraceRingMagic;
+   header.version = TraceRingVersion;
+   header.coreId = coreId;
+   header.recordSize = static_cast<uint32_t>(sizeof(TraceRecord));
+   header.capacity = core.traceMask + 1;
+   header.written = core.traceIndex;
+   file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+   // Write the records oldest first so readers don't need to unwrap them
+   auto count = std::min(header.written, header.capacity);
+
+   for (auto i = header.written - count; i < header.written; ++i) {
+      auto &record = core.traceRing[i & core.traceMask];
+      file.write(reinterpret_cast<const char *>(&record), sizeof(record));
+   }
+
+   gLog->info("Saved {} trace records for core {} to {}", count, coreId, path);
+   return true;
+}
+
+} // namespace cpu
@@ -3,6 +3,8 @@
 
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <thread>
 
 struct Tracer;
@@ -10,6 +12,8 @@ struct Tracer;
 namespace cpu
 {
 
+struct TraceRecord;
+
 static const uint32_t coreClockSpeed = 1243125000;
 static const uint32_t busClockSpeed = 248625000;
 static const uint32_t timerClockSpeed = busClockSpeed / 4;
@@ -48,9 +52,36 @@ struct Core : CoreRegs
    std::thread thread;
    uint32_t interrupt_mask { 0xFFFFFFFF };
    std::atomic<uint32_t> interrupt { 0 };
+
+   // Wait slot used by waitForInterrupt, senders only lock wakeMutex to
+   //  notify when the core is actually sleeping.
+   std::atomic<bool> sleeping { false };
+   std::mutex wakeMutex;
+   std::condition_variable wakeCondition;
    uint64_t reserve { 0xFFFFFFFFFFFFFFFF };
    std::chrono::steady_clock::time_point next_alarm;
 
+   // Guest instructions retired and instructions left until the next alarm,
+   //  these replace the host clock when running in virtual time.  The
+   //  countdown is only meaningful while has_alarm is set.
+   uint64_t virtual_time { 0 };
+   uint64_t virtual_countdown { 0 };
+   bool has_alarm { false };
+
+   // Host function table used by JIT generated code
+   void *jitImports { nullptr };
+
+   // Binary trace ring, traceIndex counts every record ever written and
+   //  traceMask + 1 is the power of two number of records in traceRing.
+   TraceRecord *traceRing { nullptr };
+   uint64_t traceIndex { 0 };
+   uint64_t traceMask { 0 };
+
+   // Set by any instruction which uses a floating point register, the
+   //  kernel clears it when restoring a context to decide whether the
+   //  floating point registers need saving again.
+   bool fpuUsed { false };
+
    uint64_t tb();
 };
 
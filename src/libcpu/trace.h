@@ -106,6 +106,14 @@ static_assert(sizeof(TraceFieldValue) == sizeof(TraceFieldValue::value), "TraceF
 std::string
 getStateFieldName(TraceFieldType type);
 
+// Sets truncated if the instruction writes more than maxFields fields
+size_t
+getTraceWriteFields(espresso::Instruction instr,
+                    espresso::InstructionInfo *data,
+                    TraceFieldType *fields,
+                    size_t maxFields,
+                    bool *truncated = nullptr);
+
 void
 saveStateField(const cpu::CoreRegs *state,
                TraceFieldType type,
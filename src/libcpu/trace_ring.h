@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+
+namespace cpu
+{
+
+// Fixed size binary trace records, each core writes these into its own
+//  ring buffer when enabled with setTraceRingSize.  This is much cheaper
+//  than the Tracer in trace.h and also works for JIT code.
+
+static const uint32_t TraceRingMagic = 0x44545243; // "DTRC"
+static const uint32_t TraceRingVersion = 2;
+static const uint32_t TraceRecordMaxFields = 2;
+
+// Set in TraceRecord::flags when the instruction wrote more fields than fit
+static const uint8_t TraceRecordTruncated = 1 << 0;
+
+#pragma pack(push, 1)
+
+struct TraceRecord
+{
+   uint32_t cia;
+   uint32_t instr;
+
+   // StateField written by the instruction, or StateField::Invalid.  Block
+   //  terminators may leave the JIT block, so both the interpreter and the
+   //  JIT record them before they execute and without any fields.
+   uint8_t fields[TraceRecordMaxFields];
+   uint8_t flags;
+   uint8_t reserved[5];
+
+   // Value of each field after the instruction executed, see saveStateField
+   uint64_t values[TraceRecordMaxFields];
+};
+
+// A saved ring is this header followed by min(written, capacity) records
+//  in the order they were executed.
+struct TraceRingHeader
+{
+   uint32_t magic;
+   uint32_t version;
+   uint32_t coreId;
+   uint32_t recordSize;
+   uint64_t capacity;
+   uint64_t written;
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(TraceRecord) == 32, "JIT code assumes 32 byte trace records");
+
+} // namespace cpu
@@ -52,6 +52,24 @@ extern bool enabled;
 //! Use JIT in verification mode where it compares execution to interpreter
 extern bool verify;
 
+//! Interpret cold code and compile hot blocks on a background thread
+extern bool tiered;
+
+//! Directory to store translated code in across runs, disabled when empty
+extern std::string cache_path;
+
+//! Count entries into each JIT block and log the hottest ones on exit
+extern bool profile;
+
+//! Write /tmp/perf-<pid>.map so perf can name JIT blocks
+extern bool perf_map;
+
+//! Use MOVBE, BMI2 and AVX in generated code when the host supports them
+extern bool host_extensions;
+
+//! Write trace ring records from generated code as well as the interpreter
+extern bool trace_ring;
+
 } // namespace jit
 
 namespace log
@@ -69,6 +87,9 @@ extern bool kernel_trace_res;
 //! Enable logging of every branch which targets a known symbol
 extern bool branch_trace;
 
+//! Number of instructions each core keeps in its binary trace ring, 0 disables
+extern unsigned trace_ring_size;
+
 //! Wildcard filters for kernel trace function name matching
 extern std::vector<std::string> kernel_trace_filters;
 
@@ -100,6 +121,9 @@ extern std::string content_path;
 //! Time scale factor for emulated clock
 extern double time_scale;
 
+//! Drive the emulated clock from guest instruction counts instead of the host
+extern bool virtual_time;
+
 } // namespace system
 
 namespace ui
@@ -2,6 +2,7 @@
 #include "libcpu/cpu.h"
 #include "libcpu/espresso/espresso_instructionid.h"
 #include "libcpu/espresso/espresso_instructionset.h"
+#include "modules/coreinit/coreinit_scheduler.h"
 #include <algorithm>
 #include <chrono>
 #include <cinttypes>
@@ -35,6 +36,9 @@ sFirstSeen = std::chrono::time_point<std::chrono::system_clock>::max();
 static uint64_t
 sFirstSeenValues[InstrCount] = { 0 };
 
+static std::vector<coreinit::internal::SchedulerLockStats>
+sSchedulerLockStats;
+
 void
 draw()
 {
@@ -118,6 +122,32 @@ draw()
       ImGui::TreePop();
    }
 
+   if (ImGui::TreeNode("Scheduler Lock"))
+   {
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+      ImGui::NextColumn();
+
+      // Keep showing the previous values if the lock is busy right now
+      if (coreinit::internal::getSchedulerLockStats(sSchedulerLockStats)) {
+         std::sort(sSchedulerLockStats.begin(), sSchedulerLockStats.end(),
+            [](const coreinit::internal::SchedulerLockStats &a, const coreinit::internal::SchedulerLockStats &b) {
+               return b.waitNanoseconds < a.waitNanoseconds;
+            });
+      }
+
+      for (auto &stats : sSchedulerLockStats) {
+         ImGui::Text("%s", stats.site.c_str());
+         ImGui::NextColumn();
+         ImGui::Text("%" PRIu64 " (%" PRIu64 " contended)", stats.acquisitions, stats.contended);
+         ImGui::NextColumn();
+         ImGui::Text("%.3f ms waiting", static_cast<double>(stats.waitNanoseconds) / 1000000.0);
+         ImGui::NextColumn();
+      }
+
+      ImGui::TreePop();
+   }
+
    ImGui::Columns(1);
    ImGui::End();
 }
@@ -11,11 +11,13 @@
 #include "kernel/kernel.h"
 #include "kernel/kernel_filesystem.h"
 #include "kernel/kernel_hlefunction.h"
+#include "kernel/kernel_loader.h"
 #include "libcpu/cpu.h"
 #include "libcpu/mem.h"
 #include "modules/coreinit/coreinit_fs.h"
 #include "modules/coreinit/coreinit_scheduler.h"
 #include "modules/swkbd/swkbd_core.h"
+#include <algorithm>
 #include <condition_variable>
 #include <mutex>
 
@@ -105,6 +107,8 @@ initialise(const std::string &gamePath)
    if (decaf::config::jit::enabled) {
       if (decaf::config::jit::verify) {
          cpu::setJitMode(cpu::jit_mode::verify);
+      } else if (decaf::config::jit::tiered) {
+         cpu::setJitMode(cpu::jit_mode::tiered);
       } else {
          cpu::setJitMode(cpu::jit_mode::enabled);
       }
@@ -112,6 +116,22 @@ initialise(const std::string &gamePath)
       cpu::setJitMode(cpu::jit_mode::disabled);
    }
 
+   // Cached code would bypass verification, so only use it in normal mode
+   if (decaf::config::jit::enabled && !decaf::config::jit::verify) {
+      cpu::setJitCacheDirectory(decaf::config::jit::cache_path);
+   }
+
+   if (decaf::config::jit::enabled) {
+      cpu::setJitProfiling(decaf::config::jit::profile);
+      cpu::setJitPerfMap(decaf::config::jit::perf_map);
+      cpu::setJitHostExtensions(decaf::config::jit::host_extensions);
+      cpu::setJitTraceRing(decaf::config::jit::trace_ring);
+   }
+
+   cpu::setTraceRingSize(decaf::config::log::trace_ring_size);
+
+   cpu::setVirtualTime(decaf::config::system::virtual_time);
+
    // Setup core
    mem::initialise();
    cpu::initialise();
@@ -213,6 +233,26 @@ waitForExit()
    return kernel::getExitCode();
 }
 
+static void
+logJitProfile()
+{
+   auto profile = cpu::getJitProfile();
+
+   std::sort(profile.begin(), profile.end(),
+             [](const cpu::JitBlockProfile &lhs, const cpu::JitBlockProfile &rhs) {
+                return lhs.entries > rhs.entries;
+             });
+
+   profile.resize(std::min<size_t>(profile.size(), 32));
+   gLog->info("Hottest JIT blocks:");
+
+   for (auto &block : profile) {
+      gLog->info("{:>12} {:08X}-{:08X} {}",
+                 block.entries, block.start, block.end,
+                 kernel::loader::findNearestSymbolNameForAddress(block.start));
+   }
+}
+
 void
 shutdown()
 {
@@ -230,6 +270,19 @@ shutdown()
    // Wait for CPU to finish
    cpu::join();
 
+   // Write out any newly translated code
+   cpu::saveJitCache();
+
+   if (decaf::config::jit::enabled && decaf::config::jit::profile) {
+      logJitProfile();
+   }
+
+   if (decaf::config::log::trace_ring_size) {
+      for (auto i = 0u; i < 3; ++i) {
+         cpu::saveTraceRing(i, fmt::format("trace_core{}.bin", i));
+      }
+   }
+
    // Stop any kernel threads
    kernel::shutdown();
 
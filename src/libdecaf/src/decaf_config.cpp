@@ -36,6 +36,12 @@ namespace jit
 
 bool enabled = true;
 bool verify = false;
+bool tiered = false;
+std::string cache_path = "";
+bool profile = false;
+bool perf_map = false;
+bool host_extensions = true;
+bool trace_ring = false;
 
 } // namespace jit
 
@@ -46,6 +52,7 @@ bool async = false;
 bool kernel_trace = false;
 bool kernel_trace_res = false;
 bool branch_trace = false;
+unsigned trace_ring_size = 0;
 
 std::vector<std::string> kernel_trace_filters =
 {
@@ -77,6 +84,7 @@ std::string mlc_path = "mlc";
 std::string sdcard_path = "sdcard";
 std::string content_path = {};
 double time_scale = 1.0;
+bool virtual_time = false;
 
 } // namespace system
 
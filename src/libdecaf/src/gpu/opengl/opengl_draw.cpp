@@ -1,5 +1,6 @@
 #ifndef DECAF_NOGL
 
+#include <common/byte_swap_array.h>
 #include <common/decaf_assert.h>
 #include "decaf_config.h"
 #include "opengl_driver.h"
@@ -282,9 +283,7 @@ GLDriver::drawPrimitivesIndexed(const void *buffer,
          decaf_abort(fmt::format("Unexpected INDEX_TYPE {} for VGT_DMA_SWAP_16_BIT", vgt_dma_index_type.INDEX_TYPE()));
       }
 
-      for (auto i = 0u; i < count; ++i) {
-         indices[i] = byte_swap(src[i]);
-      }
+      byte_swap_copy(indices.data(), src, count);
 
       drawPrimitives(count,
                      indices.data(),
@@ -297,9 +296,7 @@ GLDriver::drawPrimitivesIndexed(const void *buffer,
          decaf_abort(fmt::format("Unexpected INDEX_TYPE {} for VGT_DMA_SWAP_32_BIT", vgt_dma_index_type.INDEX_TYPE()));
       }
 
-      for (auto i = 0u; i < count; ++i) {
-         indices[i] = byte_swap(src[i]);
-      }
+      byte_swap_copy(indices.data(), src, count);
 
       drawPrimitives(count,
                      indices.data(),
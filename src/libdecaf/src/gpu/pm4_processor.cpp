@@ -1,6 +1,10 @@
+#include <algorithm>
+#include <array>
+#include <common/byte_swap_array.h>
 #include <common/log.h>
 #include "pm4_processor.h"
 #include "pm4_reader.h"
+#include <vector>
 
 namespace gpu
 {
@@ -17,11 +21,7 @@ Pm4Processor::runCommandBuffer(uint32_t *buffer, uint32_t buffer_size)
 {
    std::vector<uint32_t> swapped;
    swapped.resize(buffer_size);
-
-   for (auto i = 0u; i < buffer_size; ++i) {
-      swapped[i] = byte_swap(buffer[i]);
-   }
-
+   byte_swap_copy(swapped.data(), buffer, buffer_size);
    buffer = swapped.data();
 
    for (auto pos = 0u; pos < buffer_size; ) {
@@ -383,12 +383,21 @@ void Pm4Processor::loadRegisters(latte::Register base,
    be_val<uint32_t> *src,
    const gsl::span<std::pair<uint32_t, uint32_t>> &registers)
 {
+   static const auto ChunkSize = 256u;
+   std::array<uint32_t, ChunkSize> values;
+
    for (auto &range : registers) {
       auto start = range.first;
       auto count = range.second;
 
-      for (auto j = start; j < start + count; ++j) {
-         setRegister(static_cast<latte::Register>(base + j * 4), src[j]);
+      // Swap each range a chunk at a time rather than one register at a time
+      for (auto chunk = start; chunk < start + count; chunk += ChunkSize) {
+         auto chunkSize = std::min(start + count - chunk, ChunkSize);
+         byte_swap_copy(values.data(), src + chunk, chunkSize);
+
+         for (auto j = 0u; j < chunkSize; ++j) {
+            setRegister(static_cast<latte::Register>(base + (chunk + j) * 4), values[j]);
+         }
       }
    }
 }
@@ -7,6 +7,7 @@
 #include "kernel_memory.h"
 #include "kernel_filesystem.h"
 #include "debugger/debugger.h"
+#include "decaf_config.h"
 #include "decaf_events.h"
 #include "filesystem/filesystem.h"
 #include <common/platform_fiber.h>
@@ -115,6 +116,7 @@ initialise()
    cpu::setSegfaultHandler(&cpuSegfaultHandler);
    cpu::setIllInstHandler(&cpuIllInstHandler);
    cpu::setInterruptHandler(&cpuInterruptHandler);
+   cpu::setSymbolNameHandler(&loader::findNearestSymbolNameForAddress);
 
    if (decaf::config::log::branch_trace) {
       cpu::setBranchTraceHandler(&cpuBranchTraceHandler);
@@ -191,6 +193,11 @@ cpuFaultFiberEntryPoint(void *addr)
 
    gLog->critical("{}", coreStateToString(core));
 
+   // Keep the instructions which led up to the fault, see tools/trace-decode
+   if (decaf::config::log::trace_ring_size) {
+      cpu::saveTraceRing(core->id, fmt::format("trace_core{}_fault.bin", core->id));
+   }
+
    if (sFaultReason == FaultReason::Segfault) {
       decaf_abort(fmt::format("Invalid memory access for address {:08X} with nia 0x{:08X}\n",
          sSegfaultAddress, core->nia));
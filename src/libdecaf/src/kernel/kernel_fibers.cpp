@@ -1,6 +1,8 @@
 #include "kernel.h"
 #include <algorithm>
 #include <cfenv>
+#include <common/byte_swap_array.h>
+#include <emmintrin.h>
 #include "libcpu/cpu.h"
 #include "libcpu/mem.h"
 #include <common/platform_fiber.h>
@@ -29,32 +31,76 @@ sIdleFiber[3];
 static coreinit::OSContext
 sIdleContext[3];
 
+// Context whose floating point registers were last loaded into each core,
+//  saving back to it can be skipped if the core has not used the FPU.
+static coreinit::OSContext *
+sFpuContext[3];
+
 struct Fiber
 {
    platform::Fiber *handle = nullptr;
    coreinit::OSContext *context = nullptr;
    cpu::Tracer *tracer = nullptr;
+
+   //! Time base of the core this context last ran on when it went to sleep
+   uint64_t timeBase = 0;
 };
 
 static void
 checkDeadContext();
 
-void
-saveContext(coreinit::OSContext *context)
+// Byte swaps each 64 bit lane, SSE2 only so it can be fused with the unpacks
+//  below, byte_swap_copy is used for everything else.
+static inline __m128i
+byteSwap64x2(__m128i value)
 {
-   auto state = cpu::this_core::state();
+   value = _mm_or_si128(_mm_slli_epi16(value, 8), _mm_srli_epi16(value, 8));
+   value = _mm_shufflelo_epi16(value, _MM_SHUFFLE(0, 1, 2, 3));
+   return _mm_shufflehi_epi16(value, _MM_SHUFFLE(0, 1, 2, 3));
+}
 
-   for (auto i = 0; i < 32; ++i) {
-      context->gpr[i] = state->gpr[i];
+static void
+saveFloatRegisters(coreinit::OSContext *context, cpu::Core *state)
+{
+   auto fpr = reinterpret_cast<__m128i *>(&context->fpr[0]);
+   auto psf = reinterpret_cast<__m128i *>(&context->psf[0]);
+
+   // Each host register holds (paired0, paired1), which are split into
+   //  the fpr and psf arrays of the context two registers at a time.
+   for (auto i = 0; i < 32; i += 2) {
+      auto a = _mm_load_si128(reinterpret_cast<const __m128i *>(&state->fpr[i]));
+      auto b = _mm_load_si128(reinterpret_cast<const __m128i *>(&state->fpr[i + 1]));
+      _mm_storeu_si128(fpr + i / 2, byteSwap64x2(_mm_unpacklo_epi64(a, b)));
+      _mm_storeu_si128(psf + i / 2, byteSwap64x2(_mm_unpackhi_epi64(a, b)));
    }
+}
 
-   for (auto i = 0; i < 32; ++i) {
-      context->fpr[i] = state->fpr[i].value;
-      context->psf[i] = state->fpr[i].paired1;
+static void
+restoreFloatRegisters(cpu::Core *state, coreinit::OSContext *context)
+{
+   auto fpr = reinterpret_cast<const __m128i *>(&context->fpr[0]);
+   auto psf = reinterpret_cast<const __m128i *>(&context->psf[0]);
+
+   for (auto i = 0; i < 32; i += 2) {
+      auto a = byteSwap64x2(_mm_loadu_si128(fpr + i / 2));
+      auto b = byteSwap64x2(_mm_loadu_si128(psf + i / 2));
+      _mm_store_si128(reinterpret_cast<__m128i *>(&state->fpr[i]), _mm_unpacklo_epi64(a, b));
+      _mm_store_si128(reinterpret_cast<__m128i *>(&state->fpr[i + 1]), _mm_unpackhi_epi64(a, b));
    }
+}
+
+static void
+saveContext(coreinit::OSContext *context,
+            bool lazyFpu)
+{
+   auto state = cpu::this_core::state();
+   byte_swap_copy(&context->gpr[0], &state->gpr[0], 32);
+   byte_swap_copy(&context->gqr[0], reinterpret_cast<const uint32_t *>(&state->gqr[0]), 8);
 
-   for (auto i = 0; i < 8; ++i) {
-      context->gqr[i] = state->gqr[i].value;
+   // If this context's floating point registers are still the ones we
+   //  loaded and nothing has used the FPU since, they are already saved.
+   if (!lazyFpu || context != sFpuContext[state->id] || state->fpuUsed) {
+      saveFloatRegisters(context, state);
    }
 
    context->cr = state->cr.value;
@@ -66,23 +112,22 @@ saveContext(coreinit::OSContext *context)
    context->fpscr = state->fpscr.value;
 }
 
+void
+saveContext(coreinit::OSContext *context)
+{
+   saveContext(context, false);
+}
+
 void
 restoreContext(coreinit::OSContext *context)
 {
    auto state = cpu::this_core::state();
+   byte_swap_copy(&state->gpr[0], &context->gpr[0], 32);
+   byte_swap_copy(reinterpret_cast<uint32_t *>(&state->gqr[0]), &context->gqr[0], 8);
 
-   for (auto i = 0; i < 32; ++i) {
-      state->gpr[i] = context->gpr[i];
-   }
-
-   for (auto i = 0; i < 32; ++i) {
-      state->fpr[i].value = context->fpr[i];
-      state->fpr[i].paired1 = context->psf[i];
-   }
-
-   for (auto i = 0; i < 8; ++i) {
-      state->gqr[i].value = context->gqr[i];
-   }
+   restoreFloatRegisters(state, context);
+   sFpuContext[state->id] = context;
+   state->fpuUsed = false;
 
    state->cr.value = context->cr;
    state->lr = context->lr;
@@ -101,10 +146,12 @@ sleepCurrentContext()
    auto context = sCurrentContext[core->id];
 
    if (context) {
-      // Save all our registers to the context
-      saveContext(context);
+      // Save all our registers to the context, this is only safe to do
+      //  lazily for thread contexts as other callers save into temporaries.
+      saveContext(context, true);
       context->nia = core->nia;
       context->cia = core->cia;
+      context->fiber->timeBase = core->tb();
    } else {
       // We save the idle context's register information as well
       //  mainly so that it doesn't complain about core state loss.
@@ -135,6 +182,9 @@ wakeCurrentContext()
       core->nia = context->nia;
       core->cia = context->cia;
 
+      // The context may have last run on a core which is ahead of this one
+      cpu::this_core::syncTimeBase(context->fiber->timeBase);
+
       // Some things to help us when debugging...
       cpu::this_core::setTracer(context->fiber->tracer);
    } else {
@@ -406,7 +406,7 @@ startAlarmCallbackThreads()
       auto stack = reinterpret_cast<uint8_t*>(coreinit::internal::sysAlloc(stackSize, 8));
       auto name = coreinit::internal::sysStrDup(fmt::format("Alarm Thread {}", i));
 
-      OSCreateThread(thread, sAlarmCallbackThreadEntryPoint, i, nullptr,
+      internal::createThread(thread, sAlarmCallbackThreadEntryPoint, i, nullptr,
          reinterpret_cast<be_val<uint32_t>*>(stack + stackSize), stackSize, -1,
          static_cast<OSThreadAttributes>(1 << i));
       OSSetThreadName(thread, name);
@@ -93,7 +93,7 @@ startAppIoThreads()
       auto stack = reinterpret_cast<uint8_t*>(coreinit::internal::sysAlloc(stackSize, 8));
       auto name = coreinit::internal::sysStrDup(fmt::format("I/O Thread {}", i));
 
-      OSCreateThread(thread, sAppIoEntryPoint, i, nullptr,
+      internal::createThread(thread, sAppIoEntryPoint, i, nullptr,
                      reinterpret_cast<be_val<uint32_t>*>(stack + stackSize), stackSize, -1,
                      static_cast<OSThreadAttributes>(1 << i));
       OSSetThreadName(thread, name);
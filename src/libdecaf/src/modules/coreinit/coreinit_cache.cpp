@@ -3,6 +3,7 @@
 #include "gpu/gpu_flush.h"
 
 #include <common/align.h>
+#include <libcpu/cpu.h>
 
 namespace coreinit
 {
@@ -106,6 +107,20 @@ OSCoherencyBarrier()
 }
 
 
+/**
+ * Equivalent to icbi instruction.
+ */
+void
+ICInvalidateRange(void *addr,
+                  uint32_t size)
+{
+   // Make sure any code translated from this range gets regenerated
+   auto start = align_down(mem::untranslate(addr), 32);
+   auto end = align_up(mem::untranslate(addr) + size, 32);
+   cpu::invalidateInstructionCache(start, end - start);
+}
+
+
 void
 Module::registerCacheFunctions()
 {
@@ -118,6 +133,7 @@ Module::registerCacheFunctions()
    RegisterKernelFunction(DCTouchRange);
    RegisterKernelFunction(OSIsAddressRangeDCValid);
    RegisterKernelFunction(OSCoherencyBarrier);
+   RegisterKernelFunction(ICInvalidateRange);
 }
 
 } // namespace coreinit
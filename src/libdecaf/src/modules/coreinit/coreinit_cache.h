@@ -46,6 +46,10 @@ OSIsAddressRangeDCValid(void *addr,
 void
 OSCoherencyBarrier();
 
+void
+ICInvalidateRange(void *addr,
+                  uint32_t size);
+
 /** @} */
 
 } // namespace coreinit
@@ -0,0 +1,305 @@
+#include "coreinit_internal_expheapindex.h"
+
+#include <algorithm>
+#include <common/align.h>
+#include <common/bitutils.h>
+#include <common/decaf_assert.h>
+#include <iterator>
+
+namespace coreinit
+{
+
+namespace internal
+{
+
+static unsigned
+getSizeBin(uint32_t size)
+{
+   if (size < 16) {
+      return 0;
+   }
+
+   auto fl = 31u - clz(size);
+   auto sl = (size >> (fl - 2)) & 3;
+   return 1 + (fl - 4) * 4 + sl;
+}
+
+static uint64_t
+getBinMinSize(unsigned bin)
+{
+   if (bin == 0) {
+      return 0;
+   }
+
+   auto fl = (bin - 1) / 4 + 4;
+   auto sl = (bin - 1) % 4;
+   return (1ull << fl) + sl * (1ull << (fl - 2));
+}
+
+void
+ExpHeapFreeIndex::clear()
+{
+   mBlocks.clear();
+
+   for (auto &bin : mBins) {
+      bin.clear();
+   }
+
+   mBinMap.fill(0);
+   mTotalFreeSize = 0;
+}
+
+void
+ExpHeapFreeIndex::insert(uint32_t block,
+                         uint32_t blockSize)
+{
+   auto bin = getSizeBin(blockSize);
+   auto inserted = mBlocks.emplace(block, blockSize).second;
+   decaf_check(inserted);
+
+   mBins[bin].emplace(block, blockSize);
+   mBinMap[bin / 64] |= 1ull << (bin % 64);
+   mTotalFreeSize += blockSize;
+}
+
+void
+ExpHeapFreeIndex::erase(uint32_t block)
+{
+   auto itr = mBlocks.find(block);
+   decaf_check(itr != mBlocks.end());
+
+   auto bin = getSizeBin(itr->second);
+   mTotalFreeSize -= itr->second;
+   mBlocks.erase(itr);
+   mBins[bin].erase(block);
+
+   if (mBins[bin].empty()) {
+      mBinMap[bin / 64] &= ~(1ull << (bin % 64));
+   }
+}
+
+void
+ExpHeapFreeIndex::resize(uint32_t block,
+                         uint32_t blockSize)
+{
+   erase(block);
+   insert(block, blockSize);
+}
+
+uint32_t
+ExpHeapFreeIndex::first() const
+{
+   return mBlocks.empty() ? 0 : mBlocks.begin()->first;
+}
+
+uint32_t
+ExpHeapFreeIndex::last() const
+{
+   return mBlocks.empty() ? 0 : mBlocks.rbegin()->first;
+}
+
+
+/**
+ * Find the last free block which starts below address.
+ */
+uint32_t
+ExpHeapFreeIndex::findPrevious(uint32_t address) const
+{
+   auto itr = mBlocks.lower_bound(address);
+
+   if (itr == mBlocks.begin()) {
+      return 0;
+   }
+
+   return std::prev(itr)->first;
+}
+
+
+/**
+ * Find the first free block which starts at or above address.
+ */
+uint32_t
+ExpHeapFreeIndex::findNext(uint32_t address) const
+{
+   auto itr = mBlocks.lower_bound(address);
+
+   if (itr == mBlocks.end()) {
+      return 0;
+   }
+
+   return itr->first;
+}
+
+unsigned
+ExpHeapFreeIndex::findNextBin(unsigned bin) const
+{
+   for (auto word = bin / 64; word < mBinMap.size(); ++word) {
+      auto bits = mBinMap[word];
+
+      if (word == bin / 64) {
+         bits &= ~0ull << (bin % 64);
+      }
+
+      if (bits) {
+         return static_cast<unsigned>(word * 64 + ctz64(bits));
+      }
+   }
+
+   return NumSizeBins;
+}
+
+
+/**
+ * Find the block a walk of the free list in MEMExpHeapMode::FirstFree
+ * would choose, the lowest addressed block which fits.
+ */
+uint32_t
+ExpHeapFreeIndex::findFirstFree(uint32_t size,
+                                uint32_t alignment,
+                                MEMExpHeapDirection dir) const
+{
+   // A block this big fits no matter how much of it alignment wastes
+   auto alwaysFitsSize = uint64_t { size } + alignment - 1;
+   auto found = 0u;
+
+   for (auto bin = findNextBin(getSizeBin(size)); bin < NumSizeBins; bin = findNextBin(bin + 1)) {
+      auto &blocks = mBins[bin];
+
+      if (getBinMinSize(bin) >= alwaysFitsSize) {
+         auto block = blocks.begin()->first;
+
+         if (!found || block < found) {
+            found = block;
+         }
+
+         continue;
+      }
+
+      for (auto &itr : blocks) {
+         if (found && itr.first > found) {
+            break;
+         }
+
+         if (getAlignedBlockSize(itr.first, itr.second, alignment, dir) >= size) {
+            found = itr.first;
+            break;
+         }
+      }
+   }
+
+   return found;
+}
+
+
+/**
+ * Find the block a walk of the free list in MEMExpHeapMode::NearestSize
+ * would choose, the smallest aligned size which fits and the lowest address
+ * amongst those of equal size.
+ */
+uint32_t
+ExpHeapFreeIndex::findNearestSize(uint32_t size,
+                                  uint32_t alignment,
+                                  MEMExpHeapDirection dir) const
+{
+   auto found = 0u;
+   auto foundSize = 0xFFFFFFFFu;
+
+   for (auto bin = findNextBin(getSizeBin(size)); bin < NumSizeBins; bin = findNextBin(bin + 1)) {
+      // Alignment wastes less than alignment bytes of a block, so nothing
+      //  from here on can be a closer fit or an equal fit at a lower address.
+      if (found && getBinMinSize(bin) > uint64_t { foundSize } + alignment - 1) {
+         break;
+      }
+
+      for (auto &itr : mBins[bin]) {
+         auto alignedSize = getAlignedBlockSize(itr.first, itr.second, alignment, dir);
+
+         if (alignedSize < size) {
+            continue;
+         }
+
+         if (alignedSize < foundSize || (alignedSize == foundSize && itr.first < found)) {
+            found = itr.first;
+            foundSize = alignedSize;
+         }
+
+         if (alignedSize == size) {
+            // Exact fit, the rest of this bin is at higher addresses
+            break;
+         }
+      }
+   }
+
+   return found;
+}
+
+uint32_t
+ExpHeapFreeIndex::findFreeBlock(uint32_t size,
+                                uint32_t alignment,
+                                MEMExpHeapDirection dir,
+                                MEMExpHeapMode mode) const
+{
+   if (mode == MEMExpHeapMode::FirstFree) {
+      return findFirstFree(size, alignment, dir);
+   } else {
+      return findNearestSize(size, alignment, dir);
+   }
+}
+
+uint32_t
+ExpHeapFreeIndex::getLargestAlignedSize(uint32_t alignment,
+                                        MEMExpHeapDirection dir) const
+{
+   auto largest = 0u;
+
+   for (auto bin = NumSizeBins; bin-- > 0; ) {
+      if (mBins[bin].empty()) {
+         continue;
+      }
+
+      // Every block from here down is smaller than what we already have
+      if (getBinMinSize(bin + 1) <= largest) {
+         break;
+      }
+
+      for (auto &itr : mBins[bin]) {
+         largest = std::max(largest, getAlignedBlockSize(itr.first, itr.second, alignment, dir));
+      }
+   }
+
+   return largest;
+}
+
+uint32_t
+ExpHeapFreeIndex::getAlignedBlockSize(uint32_t block,
+                                      uint32_t blockSize,
+                                      uint32_t alignment,
+                                      MEMExpHeapDirection dir)
+{
+   auto dataStart = uint64_t { block } + BlockHeaderSize;
+   auto dataEnd = dataStart + blockSize;
+
+   if (dir == MEMExpHeapDirection::FromStart) {
+      auto alignedDataStart = align_up(dataStart, alignment);
+
+      if (alignedDataStart >= dataEnd) {
+         return 0;
+      }
+
+      return static_cast<uint32_t>(dataEnd - alignedDataStart);
+   } else if (dir == MEMExpHeapDirection::FromEnd) {
+      auto alignedDataEnd = align_down(dataEnd, alignment);
+
+      if (alignedDataEnd <= dataStart) {
+         return 0;
+      }
+
+      return static_cast<uint32_t>(alignedDataEnd - dataStart);
+   } else {
+      decaf_abort("Unexpected ExpHeap direction");
+   }
+}
+
+} // namespace internal
+
+} // namespace coreinit
@@ -0,0 +1,114 @@
+#pragma once
+#include "coreinit_enum.h"
+
+#include <array>
+#include <cstdint>
+#include <map>
+
+namespace coreinit
+{
+
+namespace internal
+{
+
+/**
+ * Host side index of the free blocks in a MEMExpHeap.
+ *
+ * The guest MEMExpHeapBlockList is authoritative, this exists so that finding
+ * a block does not have to walk and byte swap the whole free list.  Blocks are
+ * binned by size, with four bins for each power of two, and every bin is kept
+ * in address order.  The free list is also in address order so a lookup here
+ * returns exactly the block a walk of the list would have chosen.
+ *
+ * Blocks are identified by the guest address of their MEMExpHeapBlock header,
+ * 0 is used to mean no block.
+ */
+class ExpHeapFreeIndex
+{
+public:
+   // sizeof(MEMExpHeapBlock), checked in coreinit_memexpheap.cpp
+   static constexpr uint32_t BlockHeaderSize = 0x14;
+
+   // Bin 0 is every size below 16, then 4 bins per power of two up to 2^32
+   static constexpr unsigned NumSizeBins = 1 + (32 - 4) * 4;
+
+   void
+   clear();
+
+   void
+   insert(uint32_t block,
+          uint32_t blockSize);
+
+   void
+   erase(uint32_t block);
+
+   void
+   resize(uint32_t block,
+          uint32_t blockSize);
+
+   uint32_t
+   first() const;
+
+   uint32_t
+   last() const;
+
+   uint32_t
+   findPrevious(uint32_t address) const;
+
+   uint32_t
+   findNext(uint32_t address) const;
+
+   uint32_t
+   findFreeBlock(uint32_t size,
+                 uint32_t alignment,
+                 MEMExpHeapDirection dir,
+                 MEMExpHeapMode mode) const;
+
+   uint32_t
+   getLargestAlignedSize(uint32_t alignment,
+                         MEMExpHeapDirection dir) const;
+
+   uint32_t
+   getTotalFreeSize() const
+   {
+      return static_cast<uint32_t>(mTotalFreeSize);
+   }
+
+   static uint32_t
+   getAlignedBlockSize(uint32_t block,
+                       uint32_t blockSize,
+                       uint32_t alignment,
+                       MEMExpHeapDirection dir);
+
+private:
+   unsigned
+   findNextBin(unsigned bin) const;
+
+   uint32_t
+   findFirstFree(uint32_t size,
+                 uint32_t alignment,
+                 MEMExpHeapDirection dir) const;
+
+   uint32_t
+   findNearestSize(uint32_t size,
+                   uint32_t alignment,
+                   MEMExpHeapDirection dir) const;
+
+private:
+   using BlockMap = std::map<uint32_t, uint32_t>;
+
+   //! Every free block, address -> block size
+   BlockMap mBlocks;
+
+   //! Free blocks by size bin, each in address order
+   std::array<BlockMap, NumSizeBins> mBins;
+
+   //! Bit n is set when mBins[n] is not empty
+   std::array<uint64_t, (NumSizeBins + 63) / 64> mBinMap = { };
+
+   uint64_t mTotalFreeSize = 0;
+};
+
+} // namespace internal
+
+} // namespace coreinit
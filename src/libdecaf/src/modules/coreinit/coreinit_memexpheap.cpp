@@ -1,9 +1,12 @@
 #include "coreinit.h"
+#include "coreinit_internal_expheapindex.h"
 #include "coreinit_memexpheap.h"
 
 #include <common/align.h>
 #include <common/bitfield.h>
 #include <libcpu/mem.h>
+#include <map>
+#include <mutex>
 
 namespace coreinit
 {
@@ -14,6 +17,16 @@ FreeTag = 0x4654; // 'FR'
 static const auto
 UsedTag = 0x5544; // 'UD'
 
+static_assert(sizeof(MEMExpHeapBlock) == internal::ExpHeapFreeIndex::BlockHeaderSize,
+              "ExpHeapFreeIndex must agree on the block header size");
+
+static std::mutex
+sFreeBlockIndexMutex;
+
+// Host side index of each heap's free list, see getFreeBlockIndex
+static std::map<MEMExpHeap *, internal::ExpHeapFreeIndex>
+sFreeBlockIndices;
+
 static uint8_t *
 getBlockMemStart(MEMExpHeapBlock *block)
 {
@@ -41,19 +54,6 @@ getUsedMemBlock(void * mem)
    return block;
 }
 
-static bool
-listContainsBlock(MEMExpHeapBlockList *list,
-                  MEMExpHeapBlock *block)
-{
-   for (auto i = list->head; i; i = i->next) {
-      if (i == block) {
-         return true;
-      }
-   }
-
-   return false;
-}
-
 static void
 insertBlock(MEMExpHeapBlockList *list,
             MEMExpHeapBlock *prev,
@@ -85,7 +85,9 @@ static void
 removeBlock(MEMExpHeapBlockList *list,
             MEMExpHeapBlock *block)
 {
-   decaf_check(listContainsBlock(list, block));
+   // Checking the neighbours rather than walking the list keeps this O(1)
+   decaf_check(block->prev ? block->prev->next == block : list->head == block);
+   decaf_check(block->next ? block->next->prev == block : list->tail == block);
 
    if (block->prev) {
       block->prev->next = block->next;
@@ -103,38 +105,78 @@ removeBlock(MEMExpHeapBlockList *list,
    block->next = nullptr;
 }
 
-static uint32_t
-getAlignedBlockSize(MEMExpHeapBlock *block,
-                    uint32_t alignment,
-                    MEMExpHeapDirection dir)
+
+/**
+ * Get the free block index of a heap.
+ *
+ * The index is rebuilt from the guest free list whenever the two disagree
+ * about where the list starts or ends, so the guest list always wins.
+ */
+static internal::ExpHeapFreeIndex &
+getFreeBlockIndex(MEMExpHeap *heap)
 {
-   if (dir == MEMExpHeapDirection::FromStart) {
-      auto dataStart = reinterpret_cast<uint8_t *>(block) + sizeof(MEMExpHeapBlock);
-      auto dataEnd = dataStart + block->blockSize;
-      auto alignedDataStart = align_up(dataStart, alignment);
+   std::unique_lock<std::mutex> lock { sFreeBlockIndexMutex };
+   auto &index = sFreeBlockIndices[heap];
+   lock.unlock();
 
-      if (alignedDataStart >= dataEnd) {
-         return 0;
+   if (index.first() != heap->freeList.head.getAddress()
+    || index.last() != heap->freeList.tail.getAddress()) {
+      index.clear();
+
+      for (auto block = heap->freeList.head; block; block = block->next) {
+         index.insert(mem::untranslate(block), block->blockSize);
       }
+   }
 
-      return static_cast<uint32_t>(dataEnd - alignedDataStart);
-   } else if (dir == MEMExpHeapDirection::FromEnd) {
-      auto dataStart = reinterpret_cast<uint8_t *>(block) + sizeof(MEMExpHeapBlock);
-      auto dataEnd = dataStart + block->blockSize;
-      auto alignedDataEnd = align_down(dataEnd, alignment);
+   return index;
+}
 
-      if (alignedDataEnd <= dataStart) {
-         return 0;
-      }
+static void
+resetFreeBlockIndex(MEMExpHeap *heap)
+{
+   std::unique_lock<std::mutex> lock { sFreeBlockIndexMutex };
+   sFreeBlockIndices[heap].clear();
+}
 
-      return static_cast<uint32_t>(alignedDataEnd - dataStart);
-   } else {
-      decaf_abort("Unexpected ExpHeap direction");
-   }
+static void
+eraseFreeBlockIndex(MEMExpHeap *heap)
+{
+   std::unique_lock<std::mutex> lock { sFreeBlockIndexMutex };
+   sFreeBlockIndices.erase(heap);
+}
+
+static void
+insertFreeBlock(MEMExpHeap *heap,
+                internal::ExpHeapFreeIndex &index,
+                MEMExpHeapBlock *block)
+{
+   // Keep the free list sorted by address, the index relies on it
+   auto prev = index.findPrevious(mem::untranslate(block));
+   insertBlock(&heap->freeList, mem::translate<MEMExpHeapBlock>(prev), block);
+   index.insert(mem::untranslate(block), block->blockSize);
+}
+
+static void
+removeFreeBlock(MEMExpHeap *heap,
+                internal::ExpHeapFreeIndex &index,
+                MEMExpHeapBlock *block)
+{
+   removeBlock(&heap->freeList, block);
+   index.erase(mem::untranslate(block));
+}
+
+static void
+resizeFreeBlock(internal::ExpHeapFreeIndex &index,
+                MEMExpHeapBlock *block,
+                uint32_t blockSize)
+{
+   block->blockSize = blockSize;
+   index.resize(mem::untranslate(block), blockSize);
 }
 
 static MEMExpHeapBlock *
 createUsedBlockFromFreeBlock(MEMExpHeap *heap,
+                             internal::ExpHeapFreeIndex &index,
                              MEMExpHeapBlock *freeBlock,
                              uint32_t size,
                              uint32_t alignment,
@@ -144,13 +186,12 @@ createUsedBlockFromFreeBlock(MEMExpHeap *heap,
    auto expHeapAttribs = heap->attribs.value();
    auto freeBlockAttribs = freeBlock->attribs.value();
 
-   auto freeBlockPrev = freeBlock->prev;
    auto freeMemStart = getBlockMemStart(freeBlock);
    auto freeMemEnd = getBlockMemEnd(freeBlock);
 
    // Free blocks should never have alignment...
    decaf_check(!freeBlockAttribs.alignment());
-   removeBlock(&heap->freeList, freeBlock);
+   removeFreeBlock(heap, index, freeBlock);
 
    // Find where we are going to start
    uint8_t *alignedDataStart = nullptr;
@@ -184,7 +225,7 @@ createUsedBlockFromFreeBlock(MEMExpHeap *heap,
          freeBlock->prev = nullptr;
          freeBlock->tag = FreeTag;
 
-         insertBlock(&heap->freeList, freeBlockPrev, freeBlock);
+         insertFreeBlock(heap, index, freeBlock);
          topSpaceRemain = 0;
       }
    }
@@ -201,7 +242,7 @@ createUsedBlockFromFreeBlock(MEMExpHeap *heap,
          freeBlock->prev = nullptr;
          freeBlock->tag = FreeTag;
 
-         insertBlock(&heap->freeList, freeBlockPrev, freeBlock);
+         insertFreeBlock(heap, index, freeBlock);
          bottomSpaceRemain = 0;
       }
    }
@@ -227,8 +268,9 @@ createUsedBlockFromFreeBlock(MEMExpHeap *heap,
    return alignedBlock;
 }
 
-void
+static void
 releaseMemory(MEMExpHeap *heap,
+              internal::ExpHeapFreeIndex &index,
               uint8_t *memStart,
               uint8_t *memEnd)
 {
@@ -241,18 +283,9 @@ releaseMemory(MEMExpHeap *heap,
       memset(memStart, fillVal, memEnd - memStart);
    }
 
-   // Find the preceeding block to the memory we are releasing
-   MEMExpHeapBlock *prevBlock = nullptr;
-   MEMExpHeapBlock *nextBlock = heap->freeList.head;
-
-   for (auto block = heap->freeList.head; block; block = block->next) {
-      if (getBlockMemStart(block) < memStart) {
-         prevBlock = block;
-         nextBlock = block->next;
-      } else if (block >= prevBlock) {
-         break;
-      }
-   }
+   // Find the free blocks either side of the memory we are releasing
+   auto prevBlock = mem::translate<MEMExpHeapBlock>(index.findPrevious(mem::untranslate(memStart)));
+   auto nextBlock = mem::translate<MEMExpHeapBlock>(index.findNext(mem::untranslate(memStart)));
 
    MEMExpHeapBlock *freeBlock = nullptr;
 
@@ -263,7 +296,7 @@ releaseMemory(MEMExpHeap *heap,
 
       if (memStart == prevMemEnd) {
          // Previous block absorbs the new memory
-         prevBlock->blockSize += memEnd - memStart;
+         resizeFreeBlock(index, prevBlock, static_cast<uint32_t>(prevBlock->blockSize + (memEnd - memStart)));
 
          // Our free block becomes the previous one
          freeBlock = prevBlock;
@@ -280,7 +313,7 @@ releaseMemory(MEMExpHeap *heap,
       freeBlock->prev = nullptr;
       freeBlock->tag = FreeTag;
 
-      insertBlock(&heap->freeList, prevBlock, freeBlock);
+      insertFreeBlock(heap, index, freeBlock);
    }
 
    if (nextBlock) {
@@ -292,9 +325,8 @@ releaseMemory(MEMExpHeap *heap,
          // The next block needs to be merged into the freeBlock, as they
          //  are directly adjacent to each other in memory.
          auto nextBlockEnd = getBlockMemEnd(nextBlock);
-         freeBlock->blockSize += nextBlockEnd - nextBlockStart;
-
-         removeBlock(&heap->freeList, nextBlock);
+         removeFreeBlock(heap, index, nextBlock);
+         resizeFreeBlock(index, freeBlock, static_cast<uint32_t>(freeBlock->blockSize + (nextBlockEnd - nextBlockStart)));
       }
    }
 }
@@ -343,6 +375,8 @@ MEMCreateExpHeapEx(void *base,
    heap->groupId = 0;
    heap->attribs = MEMExpHeapAttribs::get(0);
 
+   // Drop anything left over from a previous heap at this address
+   resetFreeBlockIndex(heap);
    return heap;
 }
 
@@ -352,6 +386,7 @@ MEMDestroyExpHeap(MEMExpHeap *heap)
    decaf_check(heap);
    decaf_check(heap->header.tag == MEMHeapTag::ExpandedHeap);
    internal::unregisterHeap(&heap->header);
+   eraseFreeBlockIndex(heap);
    return heap;
 }
 
@@ -370,62 +405,25 @@ MEMAllocFromExpHeapEx(MEMExpHeap *heap,
    decaf_check(alignment != 0);
 
    internal::HeapLock lock(&heap->header);
+   auto &index = getFreeBlockIndex(heap);
+   auto dir = MEMExpHeapDirection::FromStart;
    MEMExpHeapBlock *newBlock = nullptr;
 
    size = align_up(size, 4);
 
    if (alignment > 0) {
-      MEMExpHeapBlock *foundBlock = nullptr;
-      uint32_t bestAlignedSize = 0xFFFFFFFF;
-
       alignment = std::max(4, alignment);
-      decaf_check((alignment & 0x3) == 0);
-
-      for (auto block = heap->freeList.head; block; block = block->next) {
-         auto alignedSize = getAlignedBlockSize(block, alignment, MEMExpHeapDirection::FromStart);
-
-         if (alignedSize >= size) {
-            if (expHeapFlags.allocMode() == MEMExpHeapMode::FirstFree) {
-               foundBlock = block;
-               break;
-            } else {
-               if (alignedSize < bestAlignedSize) {
-                  foundBlock = block;
-                  bestAlignedSize = alignedSize;
-               }
-            }
-         }
-      }
-
-      if (foundBlock) {
-         newBlock = createUsedBlockFromFreeBlock(heap, foundBlock, size, alignment, MEMExpHeapDirection::FromStart);
-      }
    } else {
       alignment = std::max(4, -alignment);
-      decaf_check((alignment & 0x3) == 0);
+      dir = MEMExpHeapDirection::FromEnd;
+   }
 
-      MEMExpHeapBlock *foundBlock = nullptr;
-      auto bestAlignedSize = 0xFFFFFFFFu;
+   decaf_check((alignment & 0x3) == 0);
 
-      for (auto block = heap->freeList.head; block; block = block->next) {
-         auto alignedSize = getAlignedBlockSize(block, alignment, MEMExpHeapDirection::FromEnd);
-
-         if (alignedSize >= size) {
-            if (expHeapFlags.allocMode() == MEMExpHeapMode::FirstFree) {
-               foundBlock = block;
-               break;
-            } else {
-               if (alignedSize < bestAlignedSize) {
-                  foundBlock = block;
-                  bestAlignedSize = alignedSize;
-               }
-            }
-         }
-      }
+   auto foundBlock = index.findFreeBlock(size, alignment, dir, expHeapFlags.allocMode());
 
-      if (foundBlock) {
-         newBlock = createUsedBlockFromFreeBlock(heap, foundBlock, size, alignment, MEMExpHeapDirection::FromEnd);
-      }
+   if (foundBlock) {
+      newBlock = createUsedBlockFromFreeBlock(heap, index, mem::translate<MEMExpHeapBlock>(foundBlock), size, alignment, dir);
    }
 
    if (!newBlock) {
@@ -447,6 +445,7 @@ MEMFreeToExpHeap(MEMExpHeap *heap,
    }
 
    internal::HeapLock lock(&heap->header);
+   auto &index = getFreeBlockIndex(heap);
 
    // Find the block
    auto dataStart = reinterpret_cast<uint8_t *>(mem);
@@ -460,7 +459,7 @@ MEMFreeToExpHeap(MEMExpHeap *heap,
    removeBlock(&heap->usedList, block);
 
    // Release the memory back to the heap free list
-   releaseMemory(heap, memStart, memEnd);
+   releaseMemory(heap, index, memStart, memEnd);
 }
 
 MEMExpHeapMode
@@ -487,13 +486,14 @@ uint32_t
 MEMAdjustExpHeap(MEMExpHeap *heap)
 {
    internal::HeapLock lock(&heap->header);
-   auto lastFreeBlock = heap->freeList.tail;
+   auto &index = getFreeBlockIndex(heap);
+   auto lastFreeBlock = heap->freeList.tail.get();
 
    if (!lastFreeBlock) {
       return 0;
    }
 
-   auto blockData = reinterpret_cast<uint8_t*>(lastFreeBlock.get()) + sizeof(MEMExpHeapBlock);
+   auto blockData = reinterpret_cast<uint8_t*>(lastFreeBlock) + sizeof(MEMExpHeapBlock);
 
    if (blockData + lastFreeBlock->blockSize != heap->header.dataEnd) {
       // This block is not for the end of the heap
@@ -502,10 +502,7 @@ MEMAdjustExpHeap(MEMExpHeap *heap)
 
    // Remove the block from the free list
    decaf_check(!lastFreeBlock->next);
-
-   if (lastFreeBlock->prev) {
-      lastFreeBlock->prev->next = nullptr;
-   }
+   removeFreeBlock(heap, index, lastFreeBlock);
 
    // Move the heaps end pointer to the true start point of this block
    heap->header.dataEnd = getBlockMemStart(lastFreeBlock);
@@ -521,6 +518,7 @@ MEMResizeForMBlockExpHeap(MEMExpHeap *heap,
                           uint32_t size)
 {
    internal::HeapLock lock(&heap->header);
+   auto &index = getFreeBlockIndex(heap);
    size = align_up(size, 4);
 
    auto heapAttribs = heap->header.attribs.value();
@@ -535,27 +533,14 @@ MEMResizeForMBlockExpHeap(MEMExpHeap *heap,
 
          block->blockSize -= releasedSpace;
 
-         releaseMemory(heap, releasedMemStart, releasedMemEnd);
+         releaseMemory(heap, index, releasedMemStart, releasedMemEnd);
       }
    } else if (size > block->blockSize) {
       auto blockMemEnd = getBlockMemEnd(block);
 
-      MEMExpHeapBlock *freeBlock = nullptr;
-      for (auto i = heap->freeList.head; i; i = i->next) {
-         auto freeBlockMemStart = getBlockMemStart(i);
-
-         if (freeBlockMemStart == blockMemEnd) {
-            freeBlock = i;
-            break;
-         }
-
-         // Free list is sorted, so we only need to search a little bit
-         if (freeBlockMemStart > blockMemEnd) {
-            break;
-         }
-      }
+      auto freeBlock = mem::translate<MEMExpHeapBlock>(index.findNext(mem::untranslate(blockMemEnd)));
 
-      if (!freeBlock) {
+      if (!freeBlock || getBlockMemStart(freeBlock) != blockMemEnd) {
          return 0;
       }
 
@@ -565,7 +550,7 @@ MEMResizeForMBlockExpHeap(MEMExpHeap *heap,
       auto freeMemSize = freeBlockMemEnd - freeBlockMemStart;
 
       // Drop the free block from the list of free regions
-      removeBlock(&heap->freeList, freeBlock);
+      removeFreeBlock(heap, index, freeBlock);
 
       // Adjust the sizing of the free area and the block
       auto newAllocSize = (size - block->blockSize);
@@ -583,7 +568,7 @@ MEMResizeForMBlockExpHeap(MEMExpHeap *heap,
       //  the memory back to the heap.  Otherwise we just tack the remainder
       //  onto the end of the block we resized.
       if (freeMemSize >= sizeof(MEMExpHeapBlock) + 0x4) {
-         releaseMemory(heap, freeBlockMemEnd - freeMemSize, freeBlockMemEnd);
+         releaseMemory(heap, index, freeBlockMemEnd - freeMemSize, freeBlockMemEnd);
       } else {
          block->blockSize += freeMemSize;
       }
@@ -596,13 +581,7 @@ uint32_t
 MEMGetTotalFreeSizeForExpHeap(MEMExpHeap *heap)
 {
    internal::HeapLock lock(&heap->header);
-   auto freeSize = 0u;
-
-   for (auto block = heap->freeList.head; block; block = block->next) {
-      freeSize += block->blockSize;
-   }
-
-   return freeSize;
+   return getFreeBlockIndex(heap).getTotalFreeSize();
 }
 
 uint32_t
@@ -610,33 +589,16 @@ MEMGetAllocatableSizeForExpHeapEx(MEMExpHeap *heap,
                                   int32_t alignment)
 {
    internal::HeapLock lock(&heap->header);
-   auto largestFree = 0u;
+   auto &index = getFreeBlockIndex(heap);
 
    if (alignment > 0) {
       decaf_check((alignment & 0x3) == 0);
-
-      for (auto block = heap->freeList.head; block; block = block->next) {
-         auto alignedSize = getAlignedBlockSize(block, alignment, MEMExpHeapDirection::FromStart);
-
-         if (alignedSize > largestFree) {
-            largestFree = alignedSize;
-         }
-      }
+      return index.getLargestAlignedSize(alignment, MEMExpHeapDirection::FromStart);
    } else {
       alignment = -alignment;
-
       decaf_check((alignment & 0x3) == 0);
-
-      for (auto block = heap->freeList.head; block; block = block->next) {
-         auto alignedSize = getAlignedBlockSize(block, alignment, MEMExpHeapDirection::FromEnd);
-
-         if (alignedSize > largestFree) {
-            largestFree = alignedSize;
-         }
-      }
+      return index.getLargestAlignedSize(alignment, MEMExpHeapDirection::FromEnd);
    }
-
-   return largestFree;
 }
 
 uint16_t
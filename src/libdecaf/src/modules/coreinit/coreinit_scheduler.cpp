@@ -1,5 +1,10 @@
 #include <array>
 #include <chrono>
+#include <emmintrin.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
 #include "coreinit.h"
 #include "coreinit_alarm.h"
 #include "coreinit_core.h"
@@ -19,7 +24,9 @@
 #include "libcpu/trace.h"
 #include "ppcutils/wfunc_call.h"
 #include "ppcutils/stackobject.h"
+#include <common/bitutils.h>
 #include <common/decaf_assert.h>
+#include <common/platform_thread.h>
 
 namespace coreinit
 {
@@ -30,15 +37,73 @@ SchedulerLockNonCpuCoreId = 1u << 31;
 static bool
 sSchedulerEnabled[3];
 
+// Number of pause loops a waiter spends per thread ahead of it in the
+//  queue, and how many rounds of that it tries before parking.
+static const uint32_t
+SchedulerLockBackoff = 32;
+
+static const uint32_t
+SchedulerLockSpinLimit = 64;
+
+// The scheduler lock is a ticket lock so that the cores and host threads
+//  get it in the order they asked for it, sSchedulerLock only records the
+//  owner for isSchedulerLocked and unlock checking.
 static std::atomic<uint32_t>
 sSchedulerLock { 0 };
 
+static std::atomic<uint32_t>
+sSchedulerLockNextTicket { 0 };
+
+static std::atomic<uint32_t>
+sSchedulerLockNowServing { 0 };
+
+static std::atomic<uint32_t>
+sSchedulerLockParked { 0 };
+
+struct SchedulerLockSiteStats
+{
+   uint64_t acquisitions = 0;
+   uint64_t contended = 0;
+   uint64_t waitNanoseconds = 0;
+};
+
+// Stats for each call site keyed by "file:line", entries are never removed
+//  so pointers to them stay valid.  The counters are only modified while
+//  holding the scheduler lock.
+static std::mutex
+sSchedulerLockSitesMutex;
+
+static std::map<std::string, SchedulerLockSiteStats>
+sSchedulerLockStats;
+
+// Each host thread's cache of the interned stats for a call site, so that
+//  lockScheduler never has to find them while holding the lock.
+static thread_local std::map<std::pair<const char *, int>, SchedulerLockSiteStats *>
+tSchedulerLockSites;
+
 static OSThreadQueue *
 sActiveThreads;
 
 static OSThreadQueue *
 sCoreRunQueue[3];
 
+// Thread priorities range from -1 to 32
+static const int32_t
+RunQueuePriorityLevels = 34;
+
+// Host side index of a core's run queue.  The guest visible queue stays
+//  sorted by priority, so each priority level is a contiguous FIFO bucket
+//  of it and we only need to know which buckets are non-empty and where
+//  each one ends to insert or erase without walking the queue.
+struct RunQueueIndex
+{
+   uint64_t bitmap = 0;
+   std::array<OSThread *, RunQueuePriorityLevels> tails = { };
+};
+
+static RunQueueIndex
+sCoreRunQueueIndex[3];
+
 static OSThread *
 sCurrentThread[3];
 
@@ -58,9 +123,119 @@ namespace internal
 {
 
 using ActiveQueue = Queue<OSThreadQueue, OSThreadLink, OSThread, &OSThread::activeLink>;
-using CoreRunQueue0 = SortedQueue<OSThreadQueue, OSThreadLink, OSThread, &OSThread::coreRunQueueLink0, threadSortFunc>;
-using CoreRunQueue1 = SortedQueue<OSThreadQueue, OSThreadLink, OSThread, &OSThread::coreRunQueueLink1, threadSortFunc>;
-using CoreRunQueue2 = SortedQueue<OSThreadQueue, OSThreadLink, OSThread, &OSThread::coreRunQueueLink2, threadSortFunc>;
+
+template<OSThreadLink OSThread::*LinkField>
+class CoreRunQueue : public Queue<OSThreadQueue, OSThreadLink, OSThread, LinkField>
+{
+   using Queue<OSThreadQueue, OSThreadLink, OSThread, LinkField>::link;
+
+   // Returns the last thread of the closest non-empty bucket before level
+   static OSThread *
+   findPrecedingTail(RunQueueIndex &index, int32_t level)
+   {
+      auto mask = index.bitmap & ((1ull << level) - 1);
+
+      if (!mask) {
+         return nullptr;
+      }
+
+      return index.tails[63 - clz64(mask)];
+   }
+
+public:
+   static void
+   insert(OSThreadQueue *queue, RunQueueIndex &index, OSThread *thread)
+   {
+      decaf_check(link(thread).next == nullptr);
+      decaf_check(link(thread).prev == nullptr);
+
+      // Insert after every thread of the same or higher priority
+      auto level = thread->priority + 1;
+      decaf_check(level >= 0 && level < RunQueuePriorityLevels);
+      OSThread *after = nullptr;
+
+      if (index.bitmap & (1ull << level)) {
+         after = index.tails[level];
+      } else {
+         after = findPrecedingTail(index, level);
+      }
+
+      if (!after) {
+         link(thread).next = queue->head;
+
+         if (queue->head) {
+            link(queue->head).prev = thread;
+         } else {
+            queue->tail = thread;
+         }
+
+         queue->head = thread;
+      } else {
+         auto next = link(after).next;
+         link(thread).prev = after;
+         link(thread).next = next;
+         link(after).next = thread;
+
+         if (next) {
+            link(next).prev = thread;
+         } else {
+            queue->tail = thread;
+         }
+      }
+
+      index.tails[level] = thread;
+      index.bitmap |= 1ull << level;
+   }
+
+   static void
+   erase(OSThreadQueue *queue, RunQueueIndex &index, OSThread *thread)
+   {
+      if (queue->head != thread && !link(thread).prev) {
+         // Not in this queue
+         return;
+      }
+
+      // Find the bucket this thread ends, if any.  We can not trust
+      //  thread->priority here as it may have changed since it was queued.
+      auto level = thread->priority + 1;
+      decaf_check(level >= 0 && level < RunQueuePriorityLevels);
+
+      if (!(index.bitmap & (1ull << level))
+       || index.tails[level] != thread) {
+         level = -1;
+
+         for (auto bits = index.bitmap; bits; ) {
+            auto bit = 63 - clz64(bits);
+
+            if (index.tails[bit] == thread) {
+               level = bit;
+               break;
+            }
+
+            bits &= ~(1ull << bit);
+         }
+      }
+
+      if (level >= 0) {
+         // The previous thread either ends the preceding bucket, or is in
+         //  the same bucket and becomes its new tail.
+         auto prev = link(thread).prev;
+
+         if (!prev || prev == findPrecedingTail(index, level)) {
+            index.bitmap &= ~(1ull << level);
+            index.tails[level] = nullptr;
+         } else {
+            index.tails[level] = prev;
+         }
+      }
+
+      Queue<OSThreadQueue, OSThreadLink, OSThread, LinkField>::erase(queue, thread);
+   }
+};
+
+using CoreRunQueue0 = CoreRunQueue<&OSThread::coreRunQueueLink0>;
+using CoreRunQueue1 = CoreRunQueue<&OSThread::coreRunQueueLink1>;
+using CoreRunQueue2 = CoreRunQueue<&OSThread::coreRunQueueLink2>;
 
 OSThread *
 getCoreRunningThread(uint32_t coreId)
@@ -101,10 +276,51 @@ getCurrentThread()
    return sCurrentThread[cpu::this_core::id()];
 }
 
+static void
+serveNextSchedulerTicket()
+{
+   // Sequentially consistent so that a waiter which parks after reading
+   //  the old ticket either sees the new one or is counted in Parked.
+   sSchedulerLockNowServing.fetch_add(1);
+
+   if (sSchedulerLockParked.load()) {
+      platform::wakeAllOnAddress(&sSchedulerLockNowServing);
+   }
+}
+
+static SchedulerLockSiteStats *
+getSchedulerLockSite(const char *file,
+                     int line)
+{
+   auto key = std::make_pair(file, line);
+   auto itr = tSchedulerLockSites.find(key);
+
+   if (itr != tSchedulerLockSites.end()) {
+      return itr->second;
+   }
+
+   // The same file may be passed with different pointers from different
+   //  translation units, so intern by the contents.
+   auto name = std::string { file[0] ? file : "unknown" };
+   auto separator = name.find_last_of("/\\");
+
+   if (separator != std::string::npos) {
+      name = name.substr(separator + 1);
+   }
+
+   name += ":" + std::to_string(line);
+
+   std::unique_lock<std::mutex> lock { sSchedulerLockSitesMutex };
+   auto site = &sSchedulerLockStats[name];
+   tSchedulerLockSites.emplace(key, site);
+   return site;
+}
+
 void
-lockScheduler()
+lockScheduler(const char *file,
+              int line)
 {
-   uint32_t expected = 0;
+   auto site = getSchedulerLockSite(file, line);
    auto id = cpu::this_core::id();
    auto core = 1 << id;
 
@@ -112,8 +328,41 @@ lockScheduler()
       core = SchedulerLockNonCpuCoreId;
    }
 
-   while (!sSchedulerLock.compare_exchange_weak(expected, core, std::memory_order_acquire)) {
-      expected = 0;
+   auto ticket = sSchedulerLockNextTicket.fetch_add(1, std::memory_order_relaxed);
+   auto serving = sSchedulerLockNowServing.load(std::memory_order_acquire);
+   auto contended = (serving != ticket);
+   auto waitStart = std::chrono::steady_clock::time_point { };
+
+   if (contended) {
+      waitStart = std::chrono::steady_clock::now();
+   }
+
+   for (auto spins = 0u; serving != ticket; ++spins) {
+      if (spins < SchedulerLockSpinLimit) {
+         // Back off in proportion to our place in the queue so that the
+         //  waiters are not all hammering the lock's cache line.
+         for (auto i = 0u; i < (ticket - serving) * SchedulerLockBackoff; ++i) {
+            _mm_pause();
+         }
+      } else {
+         // The holder has probably been descheduled by the host, stop
+         //  burning CPU and sleep until the lock is handed on.
+         sSchedulerLockParked.fetch_add(1);
+         platform::waitOnAddress(&sSchedulerLockNowServing, serving);
+         sSchedulerLockParked.fetch_sub(1);
+      }
+
+      serving = sSchedulerLockNowServing.load(std::memory_order_acquire);
+   }
+
+   sSchedulerLock.store(core, std::memory_order_relaxed);
+
+   site->acquisitions++;
+
+   if (contended) {
+      auto waitTime = std::chrono::steady_clock::now() - waitStart;
+      site->contended++;
+      site->waitNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(waitTime).count();
    }
 }
 
@@ -140,8 +389,40 @@ unlockScheduler()
       core = SchedulerLockNonCpuCoreId;
    }
 
-   auto oldCore = sSchedulerLock.exchange(0, std::memory_order_release);
+   auto oldCore = sSchedulerLock.exchange(0, std::memory_order_relaxed);
    decaf_check(oldCore == core);
+   serveNextSchedulerTicket();
+}
+
+// Copies the per call site lock statistics, this is used by the debugger
+//  so it only takes the lock if it is free rather than waiting on a
+//  core which may be paused while holding it.
+bool
+getSchedulerLockStats(std::vector<SchedulerLockStats> &stats)
+{
+   auto serving = sSchedulerLockNowServing.load(std::memory_order_acquire);
+
+   if (!sSchedulerLockNextTicket.compare_exchange_strong(serving, serving + 1, std::memory_order_acquire)) {
+      return false;
+   }
+
+   sSchedulerLock.store(SchedulerLockNonCpuCoreId, std::memory_order_relaxed);
+   stats.clear();
+
+   std::unique_lock<std::mutex> lock { sSchedulerLockSitesMutex };
+
+   for (auto &itr : sSchedulerLockStats) {
+      auto site = SchedulerLockStats { };
+      site.site = itr.first;
+      site.acquisitions = itr.second.acquisitions;
+      site.contended = itr.second.contended;
+      site.waitNanoseconds = itr.second.waitNanoseconds;
+      stats.push_back(site);
+   }
+
+   sSchedulerLock.store(0, std::memory_order_relaxed);
+   serveNextSchedulerTicket();
+   return true;
 }
 
 bool
@@ -201,24 +482,24 @@ queueThreadNoLock(OSThread *thread)
 
    // Schedule this thread on any cores which can run it!
    if (thread->attr & OSThreadAttributes::AffinityCPU0) {
-      CoreRunQueue0::insert(sCoreRunQueue[0], thread);
+      CoreRunQueue0::insert(sCoreRunQueue[0], sCoreRunQueueIndex[0], thread);
    }
 
    if (thread->attr & OSThreadAttributes::AffinityCPU1) {
-      CoreRunQueue1::insert(sCoreRunQueue[1], thread);
+      CoreRunQueue1::insert(sCoreRunQueue[1], sCoreRunQueueIndex[1], thread);
    }
 
    if (thread->attr & OSThreadAttributes::AffinityCPU2) {
-      CoreRunQueue2::insert(sCoreRunQueue[2], thread);
+      CoreRunQueue2::insert(sCoreRunQueue[2], sCoreRunQueueIndex[2], thread);
    }
 }
 
 static void
 unqueueThreadNoLock(OSThread *thread)
 {
-   CoreRunQueue0::erase(sCoreRunQueue[0], thread);
-   CoreRunQueue1::erase(sCoreRunQueue[1], thread);
-   CoreRunQueue2::erase(sCoreRunQueue[2], thread);
+   CoreRunQueue0::erase(sCoreRunQueue[0], sCoreRunQueueIndex[0], thread);
+   CoreRunQueue1::erase(sCoreRunQueue[1], sCoreRunQueueIndex[1], thread);
+   CoreRunQueue2::erase(sCoreRunQueue[2], sCoreRunQueueIndex[2], thread);
 }
 
 void
@@ -747,6 +1028,7 @@ Module::initialiseSchedulerFunctions()
       sCurrentThread[i] = nullptr;
       sCoreRunQueue[i] = coreinit::internal::sysAlloc<OSThreadQueue>();
       OSInitThreadQueue(sCoreRunQueue[i]);
+      sCoreRunQueueIndex[i] = RunQueueIndex { };
       sLastSwitchTime[i] = std::chrono::high_resolution_clock::now();
       sCorePauseTime[i] = std::chrono::time_point<std::chrono::high_resolution_clock>::max();
    }
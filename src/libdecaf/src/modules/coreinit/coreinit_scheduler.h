@@ -1,6 +1,9 @@
 #pragma once
 #include "coreinit_thread.h"
+#include <common/platform_compiler.h>
 #include <cstdint>
+#include <string>
+#include <vector>
 
 namespace coreinit
 {
@@ -11,6 +14,14 @@ struct OSThreadQueue;
 namespace internal
 {
 
+struct SchedulerLockStats
+{
+   std::string site;
+   uint64_t acquisitions;
+   uint64_t contended;
+   uint64_t waitNanoseconds;
+};
+
 void
 startDefaultCoreThreads();
 
@@ -30,7 +41,8 @@ OSThread *
 getCurrentThread();
 
 void
-lockScheduler();
+lockScheduler(const char *file = CALLER_FILE_NAME,
+              int line = CALLER_LINE);
 
 bool
 isSchedulerLocked();
@@ -38,6 +50,9 @@ isSchedulerLocked();
 void
 unlockScheduler();
 
+bool
+getSchedulerLockStats(std::vector<SchedulerLockStats> &stats);
+
 bool
 isSchedulerEnabled();
 
@@ -246,43 +246,11 @@ OSCreateThread(OSThread *thread,
                int32_t priority,
                OSThreadAttributes attributes)
 {
-   // If no affinity is defined, we need to copy the affinity from the calling thread
-   if ((attributes & OSThreadAttributes::AffinityAny) == 0) {
-      auto curAttr = internal::getCurrentThread()->attr;
-      uint32_t newAttr = attributes | (curAttr & OSThreadAttributes::AffinityAny);
-      attributes = static_cast<OSThreadAttributes>(newAttr);
-   }
-
-   // Setup OSThread
-   memset(thread, 0, sizeof(OSThread));
-   thread->tag = OSThread::Tag;
-   thread->userStackPointer = stack;
-   thread->stackStart = stack;
-   thread->stackEnd = reinterpret_cast<be_val<uint32_t>*>(reinterpret_cast<uint8_t*>(stack) - stackSize);
-   thread->basePriority = priority;
-   thread->priority = thread->basePriority;
-   thread->attr = attributes;
-
-   // Write magic stack ending!
-   *thread->stackEnd = 0xDEADBABE;
-
-   // Setup thread state
-   internal::lockScheduler();
-   InitialiseThreadState(thread, entry, argc, argv);
-   thread->id = sThreadId++;
-
-   if (entry) {
-      internal::markThreadActiveNoLock(thread);
+   if (priority < 0 || priority > 31) {
+      return FALSE;
    }
 
-   internal::unlockScheduler();
-
-   gLog->info("Thread Created: ptr {:08x}, id {:x}, basePriority {}, attr {:08x}, entry {:08x}, stackStart {:08x}, stackEnd {:08x}",
-      mem::untranslate(thread), static_cast<uint16_t>(thread->id),
-      static_cast<int32_t>(thread->basePriority), static_cast<uint32_t>(thread->attr),
-      entry, thread->stackStart.getAddress(), thread->stackEnd.getAddress());
-
-   return TRUE;
+   return internal::createThread(thread, entry, argc, argv, stack, stackSize, priority, attributes);
 }
 
 
@@ -1168,7 +1136,7 @@ startDeallocatorThreads()
       auto stack = reinterpret_cast<uint8_t*>(coreinit::internal::sysAlloc(stackSize, 8));
       auto name = coreinit::internal::sysStrDup(fmt::format("Thread Deallocator Thread {}", i));
 
-      OSCreateThread(thread, sDeallocatorThreadEntryPoint, i, nullptr,
+      createThread(thread, sDeallocatorThreadEntryPoint, i, nullptr,
          reinterpret_cast<be_val<uint32_t>*>(stack + stackSize), stackSize, -1,
          static_cast<OSThreadAttributes>(1 << i));
       OSSetThreadName(thread, name);
@@ -1188,6 +1156,60 @@ bool threadSortFunc(OSThread *lhs, OSThread *rhs)
    return lhs->priority <= rhs->priority;
 }
 
+
+/**
+ * Create a thread without checking its priority, so that system threads can
+ * use priority -1 which is not available to OSCreateThread.
+ */
+BOOL
+createThread(OSThread *thread,
+             OSThreadEntryPointFn entry,
+             uint32_t argc,
+             void *argv,
+             be_val<uint32_t> *stack,
+             uint32_t stackSize,
+             int32_t priority,
+             OSThreadAttributes attributes)
+{
+   // If no affinity is defined, we need to copy the affinity from the calling thread
+   if ((attributes & OSThreadAttributes::AffinityAny) == 0) {
+      auto curAttr = internal::getCurrentThread()->attr;
+      uint32_t newAttr = attributes | (curAttr & OSThreadAttributes::AffinityAny);
+      attributes = static_cast<OSThreadAttributes>(newAttr);
+   }
+
+   // Setup OSThread
+   memset(thread, 0, sizeof(OSThread));
+   thread->tag = OSThread::Tag;
+   thread->userStackPointer = stack;
+   thread->stackStart = stack;
+   thread->stackEnd = reinterpret_cast<be_val<uint32_t>*>(reinterpret_cast<uint8_t*>(stack) - stackSize);
+   thread->basePriority = priority;
+   thread->priority = thread->basePriority;
+   thread->attr = attributes;
+
+   // Write magic stack ending!
+   *thread->stackEnd = 0xDEADBABE;
+
+   // Setup thread state
+   internal::lockScheduler();
+   InitialiseThreadState(thread, entry, argc, argv);
+   thread->id = sThreadId++;
+
+   if (entry) {
+      internal::markThreadActiveNoLock(thread);
+   }
+
+   internal::unlockScheduler();
+
+   gLog->info("Thread Created: ptr {:08x}, id {:x}, basePriority {}, attr {:08x}, entry {:08x}, stackStart {:08x}, stackEnd {:08x}",
+      mem::untranslate(thread), static_cast<uint16_t>(thread->id),
+      static_cast<int32_t>(thread->basePriority), static_cast<uint32_t>(thread->attr),
+      entry, thread->stackStart.getAddress(), thread->stackEnd.getAddress());
+
+   return TRUE;
+}
+
 } // namespace internal
 
 } // namespace coreinit
@@ -526,6 +526,16 @@ queueThreadDeallocation(OSThread *thread);
 void
 startDeallocatorThreads();
 
+BOOL
+createThread(OSThread *thread,
+             OSThreadEntryPointFn entry,
+             uint32_t argc,
+             void *argv,
+             be_val<uint32_t> *stack,
+             uint32_t stackSize,
+             int32_t priority,
+             OSThreadAttributes attributes);
+
 void
 exitThreadNoLock(int value);
 
@@ -135,7 +135,13 @@ Module::initialiseClock()
    tm.tm_isdst = -1;
    sEpochTime = std::chrono::system_clock::from_time_t(platform::make_gm_time(tm));
 
-   sBaseClock = std::chrono::system_clock::now();
+   // In virtual time the calendar must not depend on when we were run
+   if (decaf::config::system::virtual_time) {
+      sBaseClock = sEpochTime;
+   } else {
+      sBaseClock = std::chrono::system_clock::now();
+   }
+
    auto ticksSinceEpoch = std::chrono::duration_cast<cpu::TimerDuration>(sBaseClock - sEpochTime);
    auto ticksSinceStart = cpu::TimerDuration(cpu::this_core::state()->tb());
    sBaseTicks = ticksSinceEpoch - ticksSinceStart;
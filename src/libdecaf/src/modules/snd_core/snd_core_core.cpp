@@ -321,7 +321,7 @@ startFrameAlarmThread()
    auto stack = reinterpret_cast<uint8_t*>(coreinit::internal::sysAlloc(stackSize, 8));
    auto name = coreinit::internal::sysStrDup("AX Callback Thread");
 
-   OSCreateThread(sFrameCallbackThread, sFrameCallbackThreadEntryPoint, 0, nullptr,
+   coreinit::internal::createThread(sFrameCallbackThread, sFrameCallbackThreadEntryPoint, 0, nullptr,
       reinterpret_cast<be_val<uint32_t>*>(stack + stackSize), stackSize, -1,
       static_cast<OSThreadAttributes>(1 << cpu::this_core::id()));
    OSSetThreadName(sFrameCallbackThread, name);
@@ -7,6 +7,8 @@
 #include "ppcutils/stackobject.h"
 #include "ppcutils/wfunc_call.h"
 #include <array>
+#include <common/byte_swap_array.h>
+#include <common/decaf_assert.h>
 #include <common/fixed.h>
 
 namespace snd_core
@@ -327,6 +329,31 @@ decodeVoiceSamples(int numSamples)
 
 static Pcm16Sample gTvSamples[AXNumTvDevices][AXNumTvChannels][NumOutputSamples];
 
+static void
+copySamplesToCallback(be_val<int32_t> *dst, const Pcm16Sample *src, uint32_t numSamples)
+{
+   std::array<int32_t, 144> values;
+   decaf_check(numSamples <= values.size());
+
+   for (auto i = 0u; i < numSamples; ++i) {
+      values[i] = static_cast<int32_t>(src[i]);
+   }
+
+   byte_swap_copy(dst, values.data(), numSamples);
+}
+
+static void
+copySamplesFromCallback(Pcm16Sample *dst, const be_val<int32_t> *src, uint32_t numSamples)
+{
+   std::array<int32_t, 144> values;
+   decaf_check(numSamples <= values.size());
+   byte_swap_copy(values.data(), src, numSamples);
+
+   for (auto i = 0u; i < numSamples; ++i) {
+      dst[i] = Pcm16Sample::from_data(values[i]);
+   }
+}
+
 static void
 invokeAuxCallback(AuxData &aux, uint32_t numChannels, uint32_t numSamples, Pcm16Sample samples[6][144])
 {
@@ -336,18 +363,14 @@ invokeAuxCallback(AuxData &aux, uint32_t numChannels, uint32_t numSamples, Pcm16
       auxCbData->channels = numChannels;
 
       for (auto ch = 0u; ch < numChannels; ++ch) {
-         for (auto i = 0u; i < numSamples; ++i) {
-            sCallbackData->samples[ch][i] = static_cast<int32_t>(samples[ch][i]);
-         }
+         copySamplesToCallback(sCallbackData->samples[ch], samples[ch], numSamples);
          sCallbackData->samplePtrs[ch] = &sCallbackData->samples[ch][0];
       }
 
       aux.callback(sCallbackData->samplePtrs, aux.userData, auxCbData);
 
       for (auto ch = 0u; ch < numChannels; ++ch) {
-         for (auto i = 0u; i < numSamples; ++i) {
-            samples[ch][i] = Pcm16Sample::from_data(sCallbackData->samples[ch][i]);
-         }
+         copySamplesFromCallback(samples[ch], sCallbackData->samples[ch], numSamples);
       }
    }
 }
@@ -365,11 +388,7 @@ invokeFinalMixCallback(DeviceTypeData &device, uint32_t numDevices, uint32_t num
       for (auto dev = 0u; dev < numDevices; ++dev) {
          for (auto ch = 0u; ch < numChannels; ++ch) {
             auto axChanId = (dev * numChannels) + ch;
-
-            for (auto i = 0u; i < numSamples; ++i) {
-               sCallbackData->samples[axChanId][i] = static_cast<int32_t>(samples[dev][ch][i]);
-            }
-
+            copySamplesToCallback(sCallbackData->samples[axChanId], samples[dev][ch], numSamples);
             sCallbackData->samplePtrs[axChanId] = &sCallbackData->samples[axChanId][0];
          }
       }
@@ -380,10 +399,7 @@ invokeFinalMixCallback(DeviceTypeData &device, uint32_t numDevices, uint32_t num
       for (auto dev = 0u; dev < numDevices; ++dev) {
          for (auto ch = 0u; ch < numChannels; ++ch) {
             auto axChanId = (dev * numChannels) + ch;
-
-            for (auto i = 0u; i < numSamples; ++i) {
-               samples[dev][ch][i] = Pcm16Sample::from_data(sCallbackData->samples[axChanId][i]);
-            }
+            copySamplesFromCallback(samples[dev][ch], sCallbackData->samples[axChanId], numSamples);
          }
       }
    }
@@ -90,6 +90,7 @@ struct arg_converter_t<PpcType::FLOAT, Type>
    {
       auto& x = state->fpr[f++].paired0;
       ppctype_converter_t<Type>::to_ppc(v, x);
+      state->fpuUsed = true;
    }
 };
 
@@ -106,6 +107,7 @@ struct arg_converter_t<PpcType::DOUBLE, Type>
    {
       auto& x = state->fpr[f++].paired0;
       ppctype_converter_t<Type>::to_ppc(v, x);
+      state->fpuUsed = true;
    }
 };
 
@@ -41,6 +41,7 @@ struct result_converter_t<PpcType::FLOAT, Type>
    static inline void set(cpu::Core *state, Type v)
    {
       ppctype_converter_t<Type>::to_ppc(v, state->fpr[1].value);
+      state->fpuUsed = true;
    }
 
    static inline Type get(cpu::Core *state)
@@ -55,6 +56,7 @@ struct result_converter_t<PpcType::DOUBLE, Type>
    static inline void set(cpu::Core *state, Type v)
    {
       ppctype_converter_t<Type>::to_ppc(v, state->fpr[1].value);
+      state->fpuUsed = true;
    }
 
    static inline Type get(cpu::Core *state)
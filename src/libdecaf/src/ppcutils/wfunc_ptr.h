@@ -3,6 +3,7 @@
 #include "ppctypeconv.h"
 
 #include <ostream>
+#include <libcpu/cpu.h>
 #include <libcpu/mem.h>
 
 #pragma pack(push, 1)
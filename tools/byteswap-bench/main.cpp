@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <chrono>
+#include <common/byte_swap.h>
+#include <common/byte_swap_array.h>
+#include <common/log.h>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <vector>
+
+std::shared_ptr<spdlog::logger>
+gLog;
+
+static const ByteSwapKernel Kernels[] = {
+   ByteSwapKernel::Scalar,
+   ByteSwapKernel::SSSE3,
+   ByteSwapKernel::AVX2,
+};
+
+static const char *
+getKernelName(ByteSwapKernel kernel)
+{
+   switch (kernel) {
+   case ByteSwapKernel::Scalar:
+      return "scalar";
+   case ByteSwapKernel::SSSE3:
+      return "ssse3";
+   case ByteSwapKernel::AVX2:
+      return "avx2";
+   default:
+      return "unknown";
+   }
+}
+
+// The loop the call sites used before they had byte_swap_copy
+template<typename Type>
+static void
+scalarLoop(Type *dst, const Type *src, size_t count)
+{
+   for (auto i = size_t { 0 }; i < count; ++i) {
+      dst[i] = byte_swap(src[i]);
+   }
+}
+
+template<typename Func>
+static double
+timeNs(Func func, size_t bytes)
+{
+   // Repeat until we have touched enough memory for a stable time
+   auto iterations = std::max<size_t>(1, (256 * 1024 * 1024) / std::max<size_t>(bytes, 1));
+   func();
+
+   auto start = std::chrono::steady_clock::now();
+
+   for (auto i = size_t { 0 }; i < iterations; ++i) {
+      func();
+   }
+
+   auto end = std::chrono::steady_clock::now();
+   return std::chrono::duration<double, std::nano> { end - start }.count() / iterations;
+}
+
+
+/**
+ * Check every kernel against byte_swap for every count up to a few vectors,
+ * with misaligned pointers and in place, then time them against the scalar
+ * loop.  Returns false if any kernel got a different answer.
+ */
+template<typename Type>
+static bool
+runBenchmark(const std::vector<size_t> &counts)
+{
+   auto random = std::mt19937_64 { 1 };
+   auto maxCount = std::max<size_t>(*std::max_element(counts.begin(), counts.end()), 300);
+   auto src = std::vector<Type>(maxCount + 1);
+   auto dst = std::vector<Type>(maxCount + 1);
+   auto expected = std::vector<Type>(maxCount + 1);
+   auto result = true;
+
+   for (auto &value : src) {
+      value = static_cast<Type>(random());
+   }
+
+   for (auto kernel : Kernels) {
+      if (!set_byte_swap_kernel(kernel)) {
+         continue;
+      }
+
+      for (auto count = size_t { 0 }; count < 300; ++count) {
+         for (auto offset = size_t { 0 }; offset < 2; ++offset) {
+            scalarLoop(expected.data(), src.data() + offset, count);
+            byte_swap_copy(dst.data() + 1 - offset, src.data() + offset, count);
+
+            if (std::memcmp(dst.data() + 1 - offset, expected.data(), count * sizeof(Type)) != 0) {
+               std::cout << getKernelName(kernel) << " copy of " << count << " x " << sizeof(Type) * 8
+                         << " bit values is wrong" << std::endl;
+               result = false;
+            }
+
+            std::memcpy(dst.data() + offset, src.data() + offset, count * sizeof(Type));
+            byte_swap_inplace(dst.data() + offset, count);
+
+            if (std::memcmp(dst.data() + offset, expected.data(), count * sizeof(Type)) != 0) {
+               std::cout << getKernelName(kernel) << " in place swap of " << count << " x " << sizeof(Type) * 8
+                         << " bit values is wrong" << std::endl;
+               result = false;
+            }
+         }
+      }
+   }
+
+   std::cout << sizeof(Type) * 8 << " bit" << std::endl;
+
+   for (auto count : counts) {
+      auto bytes = count * sizeof(Type);
+      auto scalar = timeNs([&]() { scalarLoop(dst.data(), src.data(), count); }, bytes);
+
+      std::cout << "  " << std::setw(8) << count << " values: scalar loop "
+                << std::fixed << std::setprecision(1) << std::setw(10) << scalar << " ns";
+
+      for (auto kernel : Kernels) {
+         if (!set_byte_swap_kernel(kernel)) {
+            continue;
+         }
+
+         auto ns = timeNs([&]() { byte_swap_copy(dst.data(), src.data(), count); }, bytes);
+         std::cout << ", " << getKernelName(kernel) << " " << std::setw(10) << ns << " ns"
+                   << " (" << std::setprecision(2) << scalar / ns << "x)" << std::setprecision(1);
+      }
+
+      std::cout << std::endl;
+   }
+
+   return result;
+}
+
+int main(int argc, char **argv)
+{
+   gLog = std::make_shared<spdlog::logger>("logger", std::make_shared<spdlog::sinks::stdout_sink_st>());
+
+   auto counts = std::vector<size_t> { 8, 64, 144 * 8, 4096, 65536, 1024 * 1024 };
+
+   if (argc > 1) {
+      counts.clear();
+
+      for (auto i = 1; i < argc; ++i) {
+         counts.push_back(static_cast<size_t>(std::stoul(argv[i])));
+      }
+   }
+
+   auto bestKernel = byte_swap_kernel();
+   std::cout << "Host kernel: " << getKernelName(bestKernel) << std::endl;
+
+   auto result = runBenchmark<uint16_t>(counts);
+   result = runBenchmark<uint32_t>(counts) && result;
+   result = runBenchmark<uint64_t>(counts) && result;
+
+   set_byte_swap_kernel(bestKernel);
+   return result ? 0 : 1;
+}
@@ -0,0 +1,449 @@
+#include <algorithm>
+#include <chrono>
+#include <common/decaf_assert.h>
+#include <common/log.h>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <vector>
+#include "hardware-test/hardwaretests.h"
+#include "libcpu/cpu.h"
+#include "libcpu/mem.h"
+#include "libcpu/espresso/espresso_instructionset.h"
+
+std::shared_ptr<spdlog::logger>
+gLog;
+
+using namespace espresso;
+
+// Every benchmark gets its own page of code so blocks never overlap
+static const uint32_t CodeBase = mem::MEM2Base;
+static const uint32_t CodeStride = 0x1000;
+
+// Source and destination buffers for the memory kernels
+static const uint32_t DataSrc = mem::MEM2Base + 0x01000000;
+static const uint32_t DataDst = mem::MEM2Base + 0x02000000;
+static const uint32_t DataSize = 0x01000000;
+
+// Maximum number of corpus instructions unrolled in a loop body
+static const uint32_t MaxBodyInstructions = 32;
+
+struct Benchmark
+{
+   std::string name;
+   std::vector<uint32_t> code;
+   double instructionsPerIteration;
+
+   // How much of the DataSrc buffer one iteration walks over
+   uint32_t bytesPerIteration;
+   std::function<void(cpu::Core *)> setup;
+};
+
+struct Options
+{
+   std::string mode = "jit";
+   std::string corpus = "tests/cpu/input";
+   std::string filter;
+   uint32_t iterations = 1 << 20;
+   uint32_t repeat = 5;
+};
+
+static Options
+sOptions;
+
+static int
+sResult = 0;
+
+static uint32_t
+encodeD(InstructionID id, uint32_t rD, uint32_t rA, int32_t simm)
+{
+   auto instr = encodeInstruction(id);
+   instr.rD = rD;
+   instr.rA = rA;
+   instr.simm = static_cast<uint32_t>(simm) & 0xFFFF;
+   return instr.value;
+}
+
+static uint32_t
+encodeAndi(uint32_t rA, uint32_t rS, uint32_t uimm)
+{
+   auto instr = encodeInstruction(InstructionID::andi);
+   instr.rS = rS;
+   instr.rA = rA;
+   instr.uimm = uimm;
+   return instr.value;
+}
+
+static uint32_t
+encodeCmpi(uint32_t rA, int32_t simm)
+{
+   auto instr = encodeInstruction(InstructionID::cmpi);
+   instr.crfD = 0;
+   instr.l = 0;
+   instr.rA = rA;
+   instr.simm = static_cast<uint32_t>(simm) & 0xFFFF;
+   return instr.value;
+}
+
+static uint32_t
+encodeBranch(uint32_t from, uint32_t to)
+{
+   auto instr = encodeInstruction(InstructionID::b);
+   instr.li = ((static_cast<int32_t>(to) - static_cast<int32_t>(from)) & 0x3FFFFFF) >> 2;
+   return instr.value;
+}
+
+static uint32_t
+encodeBc(uint32_t bo, uint32_t bi, uint32_t from, uint32_t to)
+{
+   auto instr = encodeInstruction(InstructionID::bc);
+   instr.bo = bo;
+   instr.bi = bi;
+   instr.bd = ((static_cast<int32_t>(to) - static_cast<int32_t>(from)) & 0xFFFF) >> 2;
+   return instr.value;
+}
+
+// bdnz from instruction index to instruction index
+static uint32_t
+encodeBdnz(uint32_t from, uint32_t to)
+{
+   return encodeBc(16, 0, from * 4, to * 4);
+}
+
+// beq cr0 from instruction index to instruction index
+static uint32_t
+encodeBeq(uint32_t from, uint32_t to)
+{
+   return encodeBc(12, 2, from * 4, to * 4);
+}
+
+static uint32_t
+encodeBlr()
+{
+   auto instr = encodeInstruction(InstructionID::bclr);
+   instr.bo = 20;
+   return instr.value;
+}
+
+static uint32_t
+encodePsqLoad(uint32_t frD, uint32_t rA, uint32_t qd)
+{
+   auto instr = encodeInstruction(InstructionID::psq_l);
+   instr.frD = frD;
+   instr.rA = rA;
+   instr.qd = qd;
+   instr.w = 0;
+   instr.i = 0;
+   return instr.value;
+}
+
+static uint32_t
+encodePsMadd(uint32_t frD, uint32_t frA, uint32_t frC, uint32_t frB)
+{
+   auto instr = encodeInstruction(InstructionID::ps_madd);
+   instr.frD = frD;
+   instr.frA = frA;
+   instr.frC = frC;
+   instr.frB = frB;
+   return instr.value;
+}
+
+// Unrolls the instructions from one tests/cpu/input file into a loop body
+static bool
+loadCorpusBenchmark(InstructionInfo *info, Benchmark &bench)
+{
+   auto path = sOptions.corpus + "/" + info->name;
+   std::ifstream file { path, std::ifstream::in | std::ifstream::binary };
+
+   if (!file.is_open()) {
+      return false;
+   }
+
+   hwtest::TestFile testFile;
+   cereal::BinaryInputArchive cerealInput(file);
+   cerealInput(testFile);
+
+   if (testFile.tests.empty()) {
+      return false;
+   }
+
+   auto count = std::min<size_t>(testFile.tests.size(), MaxBodyInstructions);
+   auto input = testFile.tests[0].input;
+
+   for (auto i = 0u; i < count; ++i) {
+      bench.code.push_back(testFile.tests[i].instr.value);
+   }
+
+   bench.code.push_back(encodeBdnz(static_cast<uint32_t>(count), 0));
+   bench.code.push_back(encodeBlr());
+   bench.name = info->name;
+   bench.instructionsPerIteration = static_cast<double>(count + 1);
+   bench.bytesPerIteration = 0;
+   bench.setup = [input](cpu::Core *core) {
+      core->xer = input.xer;
+      core->cr = input.cr;
+
+      for (auto i = 0; i < 4; ++i) {
+         core->gpr[i + hwtest::GPR_BASE] = input.gpr[i];
+         core->fpr[i + hwtest::FPR_BASE].paired0 = input.fr[i];
+         core->fpr[i + hwtest::FPR_BASE].paired1 = input.fr[i];
+      }
+   };
+
+   return true;
+}
+
+// Copies one word per iteration from DataSrc to DataDst
+static Benchmark
+memcpyKernel()
+{
+   auto bench = Benchmark { };
+   bench.name = "kernel_memcpy";
+   bench.code = {
+      encodeD(InstructionID::lwz, 5, 4, 0),
+      encodeD(InstructionID::stw, 5, 3, 0),
+      encodeD(InstructionID::addi, 4, 4, 4),
+      encodeD(InstructionID::addi, 3, 3, 4),
+      encodeBdnz(4, 0),
+      encodeBlr(),
+   };
+   bench.instructionsPerIteration = 5;
+   bench.bytesPerIteration = 4;
+   bench.setup = [](cpu::Core *core) {
+      core->gpr[3] = DataDst;
+      core->gpr[4] = DataSrc;
+   };
+   return bench;
+}
+
+// Paired single dot product over two float arrays, f3 accumulates
+static Benchmark
+dotProductKernel()
+{
+   auto bench = Benchmark { };
+   bench.name = "kernel_ps_dot";
+   bench.code = {
+      encodePsqLoad(1, 3, 0),
+      encodePsqLoad(2, 4, 0),
+      encodePsMadd(3, 1, 2, 3),
+      encodeD(InstructionID::addi, 3, 3, 8),
+      encodeD(InstructionID::addi, 4, 4, 8),
+      encodeBdnz(5, 0),
+      encodeBlr(),
+   };
+   bench.instructionsPerIteration = 6;
+   bench.bytesPerIteration = 16;
+   bench.setup = [](cpu::Core *core) {
+      core->gpr[3] = DataSrc;
+      core->gpr[4] = DataSrc + DataSize / 2;
+   };
+   return bench;
+}
+
+// A four way switch on a counter written as a compare chain, every
+//  iteration takes a different path through the block.
+static Benchmark
+switchKernel()
+{
+   auto bench = Benchmark { };
+   bench.name = "kernel_switch";
+   bench.code = {
+      encodeAndi(5, 6, 3),                   // 0: andi. r5, r6, 3
+      encodeCmpi(5, 0),                      // 1
+      encodeBeq(2, 9),                       // 2
+      encodeCmpi(5, 1),                      // 3
+      encodeBeq(4, 11),                      // 4
+      encodeCmpi(5, 2),                      // 5
+      encodeBeq(6, 13),                      // 6
+      encodeD(InstructionID::addi, 7, 7, 4), // 7: default
+      encodeBranch(8 * 4, 14 * 4),           // 8
+      encodeD(InstructionID::addi, 7, 7, 1), // 9: case 0
+      encodeBranch(10 * 4, 14 * 4),          // 10
+      encodeD(InstructionID::addi, 7, 7, 2), // 11: case 1
+      encodeBranch(12 * 4, 14 * 4),          // 12
+      encodeD(InstructionID::addi, 7, 7, 3), // 13: case 2
+      encodeD(InstructionID::addi, 6, 6, 1), // 14: next
+      encodeBdnz(15, 0),                     // 15
+      encodeBlr(),                           // 16
+   };
+
+   // The four paths are 7, 9, 10 and 11 instructions long
+   bench.instructionsPerIteration = 37.0 / 4.0;
+   bench.bytesPerIteration = 0;
+   bench.setup = [](cpu::Core *core) {
+      core->gpr[6] = 0;
+      core->gpr[7] = 0;
+   };
+   return bench;
+}
+
+static void
+initialiseData()
+{
+   for (auto offset = 0u; offset < DataSize; offset += 8) {
+      mem::write<float>(DataSrc + offset, 1.0f);
+      mem::write<float>(DataSrc + offset + 4, 0.5f);
+   }
+}
+
+static double
+runBenchmark(const Benchmark &bench, uint32_t address, uint32_t iterations)
+{
+   auto core = cpu::this_core::state();
+   std::memset(static_cast<cpu::CoreRegs *>(core), 0, sizeof(cpu::CoreRegs));
+   bench.setup(core);
+   core->ctr = iterations;
+   core->nia = address;
+
+   auto start = std::chrono::high_resolution_clock::now();
+   cpu::this_core::executeSub();
+   auto elapsed = std::chrono::high_resolution_clock::now() - start;
+   return std::chrono::duration_cast<std::chrono::duration<double, std::nano>>(elapsed).count();
+}
+
+static void
+reportBenchmark(const Benchmark &bench, uint32_t address)
+{
+   for (auto i = 0u; i < bench.code.size(); ++i) {
+      mem::write(address + i * 4, bench.code[i]);
+   }
+
+   cpu::invalidateInstructionCache(address, static_cast<uint32_t>(bench.code.size() * 4));
+
+   // The memory kernels must stay inside their buffers
+   auto iterations = sOptions.iterations;
+
+   if (bench.bytesPerIteration) {
+      iterations = std::min(iterations, DataSize / bench.bytesPerIteration);
+   }
+
+   // The first run after invalidation includes decoding or compiling
+   //  the block, everything after that should be cached.
+   auto firstNs = runBenchmark(bench, address, 1);
+   auto bestNs = 0.0;
+
+   for (auto i = 0u; i < sOptions.repeat; ++i) {
+      auto ns = runBenchmark(bench, address, iterations);
+
+      if (i == 0 || ns < bestNs) {
+         bestNs = ns;
+      }
+   }
+
+   auto instructions = bench.instructionsPerIteration * iterations;
+   auto nsPerIteration = bestNs / iterations;
+   auto compileNs = std::max(0.0, firstNs - nsPerIteration);
+
+   std::cout << fmt::format("{{\"benchmark\":\"{}\",\"mode\":\"{}\",\"iterations\":{},"
+                            "\"instructions\":{:.0f},\"ns\":{:.0f},\"ns_per_instruction\":{:.4f},"
+                            "\"compile_ns\":{:.0f}}}",
+                            bench.name, sOptions.mode, iterations,
+                            instructions, bestNs, bestNs / instructions,
+                            compileNs) << std::endl;
+}
+
+static void
+runBenchmarks()
+{
+   auto benchmarks = std::vector<Benchmark> { };
+
+   for (auto id = 0u; id < static_cast<uint32_t>(InstructionID::Invalid); ++id) {
+      auto bench = Benchmark { };
+
+      if (loadCorpusBenchmark(findInstructionInfo(static_cast<InstructionID>(id)), bench)) {
+         benchmarks.emplace_back(std::move(bench));
+      }
+   }
+
+   if (benchmarks.empty()) {
+      gLog->error("No instruction tests found in {}", sOptions.corpus);
+      sResult = 1;
+   }
+
+   benchmarks.emplace_back(memcpyKernel());
+   benchmarks.emplace_back(dotProductKernel());
+   benchmarks.emplace_back(switchKernel());
+   initialiseData();
+
+   auto address = CodeBase;
+
+   for (auto &bench : benchmarks) {
+      if (bench.name.find(sOptions.filter) != std::string::npos) {
+         reportBenchmark(bench, address);
+      }
+
+      address += CodeStride;
+   }
+}
+
+static bool
+parseOptions(int argc, char **argv)
+{
+   for (auto i = 1; i < argc; ++i) {
+      auto arg = std::string { argv[i] };
+
+      if (i + 1 >= argc) {
+         return false;
+      }
+
+      if (arg == "--mode") {
+         sOptions.mode = argv[++i];
+      } else if (arg == "--corpus") {
+         sOptions.corpus = argv[++i];
+      } else if (arg == "--filter") {
+         sOptions.filter = argv[++i];
+      } else if (arg == "--iterations") {
+         sOptions.iterations = static_cast<uint32_t>(std::stoul(argv[++i]));
+      } else if (arg == "--repeat") {
+         sOptions.repeat = static_cast<uint32_t>(std::stoul(argv[++i]));
+      } else {
+         return false;
+      }
+   }
+
+   return sOptions.iterations > 0
+       && sOptions.repeat > 0
+       && (sOptions.mode == "interpreter" || sOptions.mode == "jit" || sOptions.mode == "verify");
+}
+
+int main(int argc, char **argv)
+{
+   gLog = std::make_shared<spdlog::logger>("logger", std::make_shared<spdlog::sinks::stderr_sink_st>());
+   gLog->set_level(spdlog::level::warn);
+
+   if (!parseOptions(argc, argv)) {
+      std::cout << "Usage: " << argv[0]
+                << " [--mode interpreter|jit|verify] [--corpus tests/cpu/input]"
+                << " [--filter name] [--iterations n] [--repeat n]" << std::endl;
+      return 1;
+   }
+
+   // The JIT stubs are generated for the mode set at initialisation, so
+   //  each mode has to be measured in its own process.
+   if (sOptions.mode == "verify") {
+      cpu::setJitMode(cpu::jit_mode::verify);
+   } else if (sOptions.mode == "jit") {
+      cpu::setJitMode(cpu::jit_mode::enabled);
+   } else {
+      cpu::setJitMode(cpu::jit_mode::disabled);
+   }
+
+   mem::initialise();
+   cpu::initialise();
+
+   // Run the benchmarks on a single core
+   cpu::setCoreEntrypointHandler(
+      []() {
+         if (cpu::this_core::id() == 1) {
+            runBenchmarks();
+         }
+      });
+
+   cpu::start();
+   cpu::join();
+   return sResult;
+}
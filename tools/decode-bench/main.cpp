@@ -0,0 +1,228 @@
+#include <chrono>
+#include <common/byte_swap.h>
+#include <common/decaf_assert.h>
+#include <common/log.h>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <vector>
+#include <zlib.h>
+#include "libcpu/espresso/espresso_instructionset.h"
+
+std::shared_ptr<spdlog::logger>
+gLog;
+
+using namespace espresso;
+
+static const uint32_t SHF_EXECINSTR = 0x4;
+static const uint32_t SHF_DEFLATED = 0x08000000;
+
+template<typename Type>
+static Type
+readBE(const std::vector<uint8_t> &data, size_t offset)
+{
+   Type value;
+   std::memcpy(&value, data.data() + offset, sizeof(Type));
+   return byte_swap(value);
+}
+
+// Reads all the executable sections of an .rpx / .rpl as big endian words
+static bool
+readTextWords(const std::string &path, std::vector<uint32_t> &words)
+{
+   std::ifstream file { path, std::ifstream::in | std::ifstream::binary };
+
+   if (!file.is_open()) {
+      std::cout << "Could not open " << path << std::endl;
+      return false;
+   }
+
+   auto data = std::vector<uint8_t> { std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+
+   if (data.size() < 0x34 || readBE<uint32_t>(data, 0) != 0x7F454C46) {
+      std::cout << path << " is not an ELF file" << std::endl;
+      return false;
+   }
+
+   auto shoff = readBE<uint32_t>(data, 0x20);
+   auto shentsize = readBE<uint16_t>(data, 0x2E);
+   auto shnum = readBE<uint16_t>(data, 0x30);
+
+   for (auto i = 0u; i < shnum; ++i) {
+      auto header = shoff + i * shentsize;
+
+      if (header + 24 > data.size()) {
+         break;
+      }
+
+      auto flags = readBE<uint32_t>(data, header + 8);
+      auto offset = readBE<uint32_t>(data, header + 16);
+      auto size = readBE<uint32_t>(data, header + 20);
+
+      if (!(flags & SHF_EXECINSTR) || !size || offset + size > data.size()) {
+         continue;
+      }
+
+      auto section = std::vector<uint8_t> { data.begin() + offset, data.begin() + offset + size };
+
+      if (flags & SHF_DEFLATED) {
+         auto inflatedSize = static_cast<uLongf>(readBE<uint32_t>(section, 0));
+         auto inflated = std::vector<uint8_t>(inflatedSize);
+
+         if (uncompress(inflated.data(), &inflatedSize, section.data() + 4, static_cast<uLong>(section.size() - 4)) != Z_OK) {
+            std::cout << "Could not inflate section " << i << std::endl;
+            return false;
+         }
+
+         inflated.resize(inflatedSize);
+         section = std::move(inflated);
+      }
+
+      for (auto pos = 0u; pos + 4 <= section.size(); pos += 4) {
+         words.push_back(readBE<uint32_t>(section, pos));
+      }
+   }
+
+   return true;
+}
+
+// The runtime tree walk decoder which the table decoder replaced, kept here
+//  as a reference point for the benchmark.
+struct TreeEntry
+{
+   struct FieldMap
+   {
+      InstructionField field;
+      std::vector<TreeEntry> children;
+   };
+
+   FieldMap *
+   getFieldMap(InstructionField field, bool create)
+   {
+      for (auto &fieldMap : fieldMaps) {
+         if (fieldMap.field == field) {
+            return &fieldMap;
+         }
+      }
+
+      if (!create) {
+         return nullptr;
+      }
+
+      fieldMaps.push_back({ field, std::vector<TreeEntry>(1u << getInstructionFieldWidth(field)) });
+      return &fieldMaps.back();
+   }
+
+   InstructionInfo *instr = nullptr;
+   std::vector<FieldMap> fieldMaps;
+};
+
+static TreeEntry
+sTree;
+
+static void
+buildTree()
+{
+   for (auto id = 0u; id < static_cast<uint32_t>(InstructionID::Invalid); ++id) {
+      auto info = findInstructionInfo(static_cast<InstructionID>(id));
+      auto table = &sTree;
+
+      for (auto i = 0u; i < info->opcode.size() - 1; ++i) {
+         auto &op = info->opcode[i];
+         table = &table->getFieldMap(op.field, true)->children[op.value];
+      }
+
+      auto &op = info->opcode.back();
+      table->getFieldMap(op.field, true)->children[op.value].instr = info;
+   }
+}
+
+static InstructionInfo *
+treeDecode(Instruction instr)
+{
+   auto table = &sTree;
+
+   while (table) {
+      for (auto &fieldMap : table->fieldMaps) {
+         table = &fieldMap.children[getInstructionFieldValue(fieldMap.field, instr)];
+
+         if (table->instr || table->fieldMaps.size()) {
+            break;
+         }
+      }
+
+      if (table->fieldMaps.size() == 0) {
+         return table->instr;
+      }
+   }
+
+   return nullptr;
+}
+
+template<typename DecodeFn>
+static double
+benchmark(const std::vector<uint32_t> &words, unsigned passes, DecodeFn decode, uint64_t &valid)
+{
+   auto start = std::chrono::high_resolution_clock::now();
+   valid = 0;
+
+   for (auto pass = 0u; pass < passes; ++pass) {
+      for (auto word : words) {
+         valid += decode(word) ? 1 : 0;
+      }
+   }
+
+   auto elapsed = std::chrono::high_resolution_clock::now() - start;
+   auto ns = std::chrono::duration_cast<std::chrono::duration<double, std::nano>>(elapsed).count();
+   return ns / (static_cast<double>(words.size()) * passes);
+}
+
+int main(int argc, char **argv)
+{
+   gLog = std::make_shared<spdlog::logger>("logger", std::make_shared<spdlog::sinks::stdout_sink_st>());
+
+   if (argc < 2) {
+      std::cout << "Usage: " << argv[0] << " <file.rpx> [passes]" << std::endl;
+      return 1;
+   }
+
+   auto passes = argc > 2 ? static_cast<unsigned>(std::stoul(argv[2])) : 20u;
+   auto words = std::vector<uint32_t> { };
+
+   if (!readTextWords(argv[1], words) || words.empty()) {
+      return 1;
+   }
+
+   initialiseInstructionSet();
+   buildTree();
+
+   // Make sure both decoders agree before timing anything
+   auto mismatches = 0u;
+
+   for (auto word : words) {
+      if (decodeInstruction(word) != treeDecode(word)) {
+         ++mismatches;
+      }
+   }
+
+   auto tableValid = uint64_t { 0 };
+   auto treeValid = uint64_t { 0 };
+   auto tableNs = benchmark(words, passes, [](uint32_t word) { return decodeInstruction(word); }, tableValid);
+   auto treeNs = benchmark(words, passes, [](uint32_t word) { return treeDecode(word); }, treeValid);
+
+   std::cout << "Decoded " << words.size() << " words x " << passes << " passes, "
+             << tableValid / passes << " valid instructions" << std::endl;
+   std::cout << "  table: " << tableNs << " ns/instruction" << std::endl;
+   std::cout << "  tree:  " << treeNs << " ns/instruction" << std::endl;
+   std::cout << "  speedup: " << treeNs / tableNs << "x" << std::endl;
+
+   if (mismatches) {
+      std::cout << mismatches << " words decoded differently!" << std::endl;
+      return 1;
+   }
+
+   return 0;
+}
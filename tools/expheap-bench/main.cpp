@@ -0,0 +1,415 @@
+#include <algorithm>
+#include <chrono>
+#include <common/align.h>
+#include <common/byte_swap.h>
+#include <common/decaf_assert.h>
+#include <common/log.h>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <vector>
+#include "modules/coreinit/coreinit_internal_expheapindex.h"
+
+std::shared_ptr<spdlog::logger>
+gLog;
+
+using coreinit::MEMExpHeapDirection;
+using coreinit::MEMExpHeapMode;
+using coreinit::internal::ExpHeapFreeIndex;
+
+// Address of the simulated heap, 0 must never be a valid block
+static const uint32_t HeapBase = 0x10000000;
+static const uint32_t HeapSize = 64 * 1024 * 1024;
+
+static const uint32_t HeaderSize = ExpHeapFreeIndex::BlockHeaderSize;
+
+// Same layout as MEMExpHeapBlock, every field big endian
+struct BlockHeader
+{
+   uint32_t attribs;
+   uint32_t blockSize;
+   uint32_t prev;
+   uint32_t next;
+   uint32_t tag;
+};
+
+static_assert(sizeof(BlockHeader) == HeaderSize, "BlockHeader must match MEMExpHeapBlock");
+
+struct Allocation
+{
+   uint32_t memStart;
+   uint32_t memEnd;
+   uint32_t data;
+};
+
+/**
+ * A MEMExpHeap free list in big endian memory, following the same split and
+ * coalesce rules as coreinit_memexpheap.cpp.  Searches either walk the list
+ * as MEMAllocFromExpHeapEx used to, or go through ExpHeapFreeIndex.
+ */
+class SimulatedHeap
+{
+public:
+   SimulatedHeap(bool useIndex) :
+      mUseIndex(useIndex),
+      mMemory(HeapSize)
+   {
+      mHead = 0;
+      mTail = 0;
+      insertFree(HeapBase, HeapBase + HeapSize);
+   }
+
+   Allocation
+   alloc(uint32_t size,
+         int32_t alignment,
+         MEMExpHeapMode mode)
+   {
+      auto dir = MEMExpHeapDirection::FromStart;
+      size = align_up(std::max(size, 1u), 4);
+
+      if (alignment < 0) {
+         dir = MEMExpHeapDirection::FromEnd;
+         alignment = -alignment;
+      }
+
+      alignment = std::max(4, alignment);
+
+      auto block = mUseIndex ? mIndex.findFreeBlock(size, alignment, dir, mode) : walkFind(size, alignment, dir, mode);
+
+      if (!block) {
+         return { 0, 0, 0 };
+      }
+
+      auto memStart = block;
+      auto memEnd = block + HeaderSize + getSize(block);
+      removeFree(block);
+
+      auto data = uint32_t { 0 };
+
+      if (dir == MEMExpHeapDirection::FromStart) {
+         data = align_up(memStart + HeaderSize, alignment);
+      } else {
+         data = align_down(memEnd - size, alignment);
+      }
+
+      auto topSpace = (data - HeaderSize) - memStart;
+      auto bottomSpace = memEnd - (data + size);
+
+      if (topSpace > HeaderSize + 4) {
+         insertFree(memStart, memStart + topSpace);
+         memStart += topSpace;
+      }
+
+      if (bottomSpace > HeaderSize + 4) {
+         insertFree(memEnd - bottomSpace, memEnd);
+         memEnd -= bottomSpace;
+      }
+
+      return { memStart, memEnd, data };
+   }
+
+   void
+   free(const Allocation &allocation)
+   {
+      auto memStart = allocation.memStart;
+      auto memEnd = allocation.memEnd;
+      auto prev = uint32_t { 0 };
+      auto next = uint32_t { 0 };
+
+      if (mUseIndex) {
+         prev = mIndex.findPrevious(memStart);
+         next = mIndex.findNext(memStart);
+      } else {
+         walkNeighbours(memStart, prev, next);
+      }
+
+      auto block = uint32_t { 0 };
+
+      if (prev && prev + HeaderSize + getSize(prev) == memStart) {
+         resizeFree(prev, getSize(prev) + (memEnd - memStart));
+         block = prev;
+      } else {
+         block = insertFree(memStart, memEnd);
+      }
+
+      if (next && next == memEnd) {
+         auto nextSize = getSize(next);
+         removeFree(next);
+         resizeFree(block, getSize(block) + HeaderSize + nextSize);
+      }
+   }
+
+   uint32_t
+   numFreeBlocks() const
+   {
+      auto count = 0u;
+
+      for (auto block = mHead; block; block = getNext(block)) {
+         ++count;
+      }
+
+      return count;
+   }
+
+private:
+   BlockHeader *
+   header(uint32_t block)
+   {
+      return reinterpret_cast<BlockHeader *>(mMemory.data() + (block - HeapBase));
+   }
+
+   const BlockHeader *
+   header(uint32_t block) const
+   {
+      return reinterpret_cast<const BlockHeader *>(mMemory.data() + (block - HeapBase));
+   }
+
+   uint32_t getSize(uint32_t block) const { return byte_swap(header(block)->blockSize); }
+   uint32_t getPrev(uint32_t block) const { return byte_swap(header(block)->prev); }
+   uint32_t getNext(uint32_t block) const { return byte_swap(header(block)->next); }
+   void setSize(uint32_t block, uint32_t value) { header(block)->blockSize = byte_swap(value); }
+   void setPrev(uint32_t block, uint32_t value) { header(block)->prev = byte_swap(value); }
+   void setNext(uint32_t block, uint32_t value) { header(block)->next = byte_swap(value); }
+
+   // The search MEMAllocFromExpHeapEx did before it had an index
+   uint32_t
+   walkFind(uint32_t size,
+            uint32_t alignment,
+            MEMExpHeapDirection dir,
+            MEMExpHeapMode mode) const
+   {
+      auto found = uint32_t { 0 };
+      auto bestAlignedSize = 0xFFFFFFFFu;
+
+      for (auto block = mHead; block; block = getNext(block)) {
+         auto alignedSize = ExpHeapFreeIndex::getAlignedBlockSize(block, getSize(block), alignment, dir);
+
+         if (alignedSize >= size) {
+            if (mode == MEMExpHeapMode::FirstFree) {
+               return block;
+            } else if (alignedSize < bestAlignedSize) {
+               found = block;
+               bestAlignedSize = alignedSize;
+            }
+         }
+      }
+
+      return found;
+   }
+
+   // The search releaseMemory did before it had an index
+   void
+   walkNeighbours(uint32_t address,
+                  uint32_t &prev,
+                  uint32_t &next) const
+   {
+      prev = 0;
+      next = mHead;
+
+      for (auto block = mHead; block; block = getNext(block)) {
+         if (block >= address) {
+            break;
+         }
+
+         prev = block;
+         next = getNext(block);
+      }
+   }
+
+   uint32_t
+   insertFree(uint32_t memStart,
+              uint32_t memEnd)
+   {
+      auto block = memStart;
+      auto prev = uint32_t { 0 };
+      auto next = uint32_t { 0 };
+
+      if (mUseIndex) {
+         prev = mIndex.findPrevious(block);
+      } else {
+         walkNeighbours(block, prev, next);
+      }
+
+      next = prev ? getNext(prev) : mHead;
+
+      std::memset(header(block), 0, sizeof(BlockHeader));
+      setSize(block, (memEnd - memStart) - HeaderSize);
+      setPrev(block, prev);
+      setNext(block, next);
+
+      if (prev) {
+         setNext(prev, block);
+      } else {
+         mHead = block;
+      }
+
+      if (next) {
+         setPrev(next, block);
+      } else {
+         mTail = block;
+      }
+
+      if (mUseIndex) {
+         mIndex.insert(block, getSize(block));
+      }
+
+      return block;
+   }
+
+   void
+   removeFree(uint32_t block)
+   {
+      auto prev = getPrev(block);
+      auto next = getNext(block);
+
+      if (prev) {
+         setNext(prev, next);
+      } else {
+         mHead = next;
+      }
+
+      if (next) {
+         setPrev(next, prev);
+      } else {
+         mTail = prev;
+      }
+
+      if (mUseIndex) {
+         mIndex.erase(block);
+      }
+   }
+
+   void
+   resizeFree(uint32_t block,
+              uint32_t blockSize)
+   {
+      setSize(block, blockSize);
+
+      if (mUseIndex) {
+         mIndex.resize(block, blockSize);
+      }
+   }
+
+private:
+   bool mUseIndex;
+   std::vector<uint8_t> mMemory;
+   uint32_t mHead;
+   uint32_t mTail;
+   ExpHeapFreeIndex mIndex;
+};
+
+struct Result
+{
+   std::vector<uint32_t> addresses;
+   uint32_t fragments = 0;
+   uint64_t operations = 0;
+   double seconds = 0.0;
+};
+
+/**
+ * Fill the heap with small blocks, free every other one to leave it
+ * fragmented, then churn random allocations and frees over the top.
+ */
+static Result
+runWorkload(bool useIndex,
+            unsigned numBlocks,
+            unsigned numOps,
+            unsigned seed)
+{
+   static const int32_t Alignments[] = { 4, 4, 4, 32, 64, 256, -4, -4, -32, -128 };
+
+   auto heap = SimulatedHeap { useIndex };
+   auto random = std::mt19937 { seed };
+   auto sizeDist = std::uniform_int_distribution<uint32_t> { 16, 2048 };
+   auto alignDist = std::uniform_int_distribution<size_t> { 0, sizeof(Alignments) / sizeof(Alignments[0]) - 1 };
+   auto live = std::vector<Allocation> { };
+   auto result = Result { };
+
+   auto start = std::chrono::steady_clock::now();
+
+   for (auto i = 0u; i < numBlocks; ++i) {
+      auto allocation = heap.alloc(sizeDist(random), 4, MEMExpHeapMode::FirstFree);
+      result.addresses.push_back(allocation.data);
+      result.operations++;
+
+      if (allocation.data) {
+         live.push_back(allocation);
+      }
+   }
+
+   auto fragmented = std::vector<Allocation> { };
+
+   for (auto i = 0u; i < live.size(); ++i) {
+      if (i % 2) {
+         heap.free(live[i]);
+         result.operations++;
+      } else {
+         fragmented.push_back(live[i]);
+      }
+   }
+
+   live.swap(fragmented);
+   result.fragments = heap.numFreeBlocks();
+
+   for (auto mode : { MEMExpHeapMode::FirstFree, MEMExpHeapMode::NearestSize }) {
+      for (auto i = 0u; i < numOps; ++i) {
+         if (!live.empty() && (random() & 1)) {
+            auto index = random() % live.size();
+            heap.free(live[index]);
+            live[index] = live.back();
+            live.pop_back();
+         } else {
+            auto size = sizeDist(random);
+            auto alignment = Alignments[alignDist(random)];
+
+            if (alignment < 0) {
+               // A FromEnd block is placed by aligning its start, which only
+               //  stays inside the block the search found when the size is a
+               //  multiple of the alignment.
+               size = align_up(size, -alignment);
+            }
+
+            auto allocation = heap.alloc(size, alignment, mode);
+            result.addresses.push_back(allocation.data);
+
+            if (allocation.data) {
+               live.push_back(allocation);
+            }
+         }
+
+         result.operations++;
+      }
+   }
+
+   auto end = std::chrono::steady_clock::now();
+   result.seconds = std::chrono::duration<double> { end - start }.count();
+   return result;
+}
+
+int main(int argc, char **argv)
+{
+   gLog = std::make_shared<spdlog::logger>("logger", std::make_shared<spdlog::sinks::stdout_sink_st>());
+
+   auto numBlocks = argc > 1 ? static_cast<unsigned>(std::stoul(argv[1])) : 20000u;
+   auto numOps = argc > 2 ? static_cast<unsigned>(std::stoul(argv[2])) : 50000u;
+   auto seed = argc > 3 ? static_cast<unsigned>(std::stoul(argv[3])) : 1u;
+
+   auto list = runWorkload(false, numBlocks, numOps, seed);
+   auto index = runWorkload(true, numBlocks, numOps, seed);
+
+   std::cout << numBlocks << " blocks, " << list.fragments << " free fragments, "
+             << list.operations << " operations" << std::endl;
+   std::cout << "  list walk: " << list.seconds * 1e9 / list.operations << " ns/op" << std::endl;
+   std::cout << "  index:     " << index.seconds * 1e9 / index.operations << " ns/op" << std::endl;
+   std::cout << "  speedup: " << list.seconds / index.seconds << "x" << std::endl;
+
+   if (list.addresses != index.addresses) {
+      std::cout << "Index chose different blocks to the list walk!" << std::endl;
+      return 1;
+   }
+
+   return 0;
+}
@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <common/bit_cast.h>
+#include <common/log.h>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <vector>
+#include "libcpu/espresso/espresso_disassembler.h"
+#include "libcpu/espresso/espresso_instructionset.h"
+#include "libcpu/trace.h"
+#include "libcpu/trace_ring.h"
+
+std::shared_ptr<spdlog::logger>
+gLog;
+
+static bool
+readTraceRing(const std::string &path,
+              cpu::TraceRingHeader &header,
+              std::vector<cpu::TraceRecord> &records)
+{
+   std::ifstream file { path, std::ifstream::in | std::ifstream::binary };
+
+   if (!file.is_open()) {
+      std::cout << "Could not open " << path << std::endl;
+      return false;
+   }
+
+   if (!file.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+      std::cout << "Could not read trace ring header" << std::endl;
+      return false;
+   }
+
+   if (header.magic != cpu::TraceRingMagic
+    || header.version != cpu::TraceRingVersion
+    || header.recordSize != sizeof(cpu::TraceRecord)) {
+      std::cout << path << " is not a supported trace ring" << std::endl;
+      return false;
+   }
+
+   auto count = std::min(header.written, header.capacity);
+   records.resize(static_cast<size_t>(count));
+
+   if (!file.read(reinterpret_cast<char *>(records.data()), records.size() * sizeof(cpu::TraceRecord))) {
+      records.resize(static_cast<size_t>(file.gcount() / sizeof(cpu::TraceRecord)));
+      std::cout << "Trace ring is truncated, read " << records.size() << " of " << count << " records" << std::endl;
+   }
+
+   return true;
+}
+
+static void
+printFieldValue(fmt::MemoryWriter &out,
+                TraceFieldType type,
+                uint64_t value)
+{
+   auto name = getStateFieldName(type);
+
+   if (type >= StateField::FPR0 && type <= StateField::FPR31) {
+      out.write("    {} = {} ({:016x})\n", name, bit_cast<double>(value), value);
+   } else {
+      out.write("    {} = {:08x}\n", name, static_cast<uint32_t>(value));
+   }
+}
+
+int main(int argc, char **argv)
+{
+   gLog = std::make_shared<spdlog::logger>("logger", std::make_shared<spdlog::sinks::stdout_sink_st>());
+
+   if (argc < 2) {
+      std::cout << "Usage: " << argv[0] << " <trace.bin> [count]" << std::endl;
+      return 1;
+   }
+
+   auto header = cpu::TraceRingHeader { };
+   auto records = std::vector<cpu::TraceRecord> { };
+
+   if (!readTraceRing(argv[1], header, records)) {
+      return 1;
+   }
+
+   auto count = records.size();
+
+   if (argc > 2) {
+      count = std::min<size_t>(count, std::stoul(argv[2]));
+   }
+
+   espresso::initialiseInstructionSet();
+
+   // Match tracePrint, index 0 is the most recently executed instruction
+   fmt::MemoryWriter out;
+   out.write("Trace - Core {}, {} instructions executed\n", header.coreId, header.written);
+   out.write("Trace - Print {} to {}\n", 0, count);
+
+   for (auto i = 0u; i < count; ++i) {
+      auto &record = records[records.size() - 1 - i];
+      auto instr = espresso::Instruction { record.instr };
+      espresso::Disassembly dis;
+
+      if (!espresso::disassemble(instr, dis, record.cia)) {
+         dis.text = fmt::format(".word 0x{:08x}", record.instr);
+      }
+
+      if (record.flags & cpu::TraceRecordTruncated) {
+         out.write("    (more fields were written than fit in the record)\n");
+      }
+
+      for (auto j = 0u; j < cpu::TraceRecordMaxFields; ++j) {
+         if (record.fields[j] != StateField::Invalid) {
+            printFieldValue(out, record.fields[j], record.values[j]);
+         }
+      }
+
+      out.write("  [{}] {:08x} {}\n", i, record.cia, dis.text);
+   }
+
+   std::cout << out.str();
+   return 0;
+}